@@ -0,0 +1,80 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "alloccount.hpp"
+
+// Every form of new and delete is replaced, so each allocation is counted
+// and freed by its match. They live apart from their callers so the
+// compiler cannot inline one half of a pair and flag the other as
+// mismatched.
+
+namespace
+{
+    std::atomic<std::size_t> allocations(0);
+
+    void *allocate(std::size_t size) noexcept
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return std::malloc(size ? size : 1);
+    }
+}
+
+std::size_t gltop::getAllocations()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void *operator new(std::size_t size)
+{
+    if(void *p = allocate(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    if(void *p = allocate(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    std::free(p);
+}
@@ -0,0 +1,15 @@
+#ifndef GLTOP_ALLOCCOUNT_HPP
+#define GLTOP_ALLOCCOUNT_HPP
+
+#include <cstddef>
+
+namespace gltop
+{
+    // Heap allocations made so far. Linking alloccount.cpp into a program
+    // replaces every form of operator new and delete with counting ones;
+    // gltop_bench uses it to check the collector does not allocate once
+    // warmed up.
+    std::size_t getAllocations();
+}
+
+#endif /* GLTOP_ALLOCCOUNT_HPP */
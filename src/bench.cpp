@@ -0,0 +1,1181 @@
+// Benchmarks for gltop's /proc collector, process tree, model and texture
+// loaders, map layout and session recorder, and, given an EGL driver,
+// headless rendering of the map. Mesa's llvmpipe is enough; no GPU is
+// needed.
+//
+// Usage: gltop_bench [iterations] [procfs root] [--cgroup-root dir]
+//                    [--json file]
+//
+// The roots default to /proc and /sys/fs/cgroup; gltop_procgen writes
+// synthetic ones of both. With --json, the results are also written to
+// file, to compare runs across commits. Exits non-zero if a session log
+// or the history ring does not read back as it was written, or a priority
+// process's PSS is not read without a budget, so the ctest run checks
+// those too.
+
+extern "C" {
+#include <unistd.h>
+#ifdef GLTOP_HAVE_PROCPS
+#include <proc/procps.h>
+#include <proc/readproc.h>
+#endif
+}
+
+#ifdef GLTOP_HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "alloccount.hpp"
+#include "bmptotexture.hpp"
+#include "cgroup.hpp"
+#include "gltop.hpp"
+#include "history.hpp"
+#include "io.hpp"
+#include "layout.hpp"
+#include "memory.hpp"
+#include "procfs.hpp"
+#include "recorder.hpp"
+#include "store.hpp"
+#include "system.hpp"
+#ifdef GLTOP_HAVE_EGL
+#include "loadobj.hpp"
+#endif
+
+namespace chron = std::chrono;
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct result
+    {
+        double msPerIter = 0.;
+        double allocsPerIter = 0.;
+        std::size_t tasks = 0;
+    };
+
+    // Run f once to warm up, then iterations times, timing the lot.
+    template<typename F>
+    result run(int iterations, F f)
+    {
+        result r;
+        r.tasks = f();
+        std::size_t startAllocs = gltop::getAllocations();
+        auto start = chron::steady_clock::now();
+        for(int i = 0; i < iterations; i++)
+            r.tasks = f();
+        auto end = chron::steady_clock::now();
+        r.msPerIter = chron::duration<double, std::milli>(end - start).count()
+            / iterations;
+        r.allocsPerIter = static_cast<double>
+            (gltop::getAllocations() - startAllocs) / iterations;
+        return r;
+    }
+
+    // Everything reported, for --json.
+    std::vector<std::pair<std::string, result>> results;
+
+    void report(const char *name, const result &r)
+    {
+        std::printf("%-28s %10.3f ms/scan %10zu tasks %10.1f allocs/scan\n",
+                    name, r.msPerIter, r.tasks, r.allocsPerIter);
+        results.emplace_back(name, r);
+    }
+
+    // Other measurements (sizes, say): name, value and unit.
+    std::vector<std::tuple<std::string, double, std::string>> figures;
+
+    void reportFigure(const char *name, double value, const char *unit)
+    {
+        std::printf("%-28s %10.1f %s\n", name, value, unit);
+        figures.emplace_back(name, value, unit);
+    }
+
+    // Write the results as JSON: the run's settings, then one object per
+    // benchmark and per figure. Returns false if path could not be written.
+    bool writeJson(const std::string &path, int iterations,
+                   const std::string &root, const std::string &renderer)
+    {
+        std::FILE *fp = std::fopen(path.c_str(), "w");
+        if(!fp)
+            return false;
+        // Names and paths only need quotes and backslashes escaped.
+        auto quote = [](const std::string &text)
+        {
+            std::string quoted = "\"";
+            for(char c : text)
+            {
+                if(c == '"' || c == '\\')
+                    quoted += '\\';
+                quoted += c;
+            }
+            return quoted + '"';
+        };
+        std::fprintf(fp, "{\n  \"iterations\": %d,\n  \"procRoot\": %s,\n"
+                     "  \"cpus\": %u,\n  \"renderer\": %s,\n"
+                     "  \"results\": [\n", iterations, quote(root).c_str(),
+                     std::thread::hardware_concurrency(),
+                     quote(renderer).c_str());
+        for(std::size_t i = 0; i < results.size(); i++)
+        {
+            const auto &[name, r] = results[i];
+            std::fprintf(fp, "    {\"name\": %s, \"msPerIter\": %.6f, "
+                         "\"tasks\": %zu, \"allocsPerIter\": %.1f}%s\n",
+                         quote(name).c_str(), r.msPerIter, r.tasks,
+                         r.allocsPerIter,
+                         (i + 1 < results.size()) ? "," : "");
+        }
+        std::fprintf(fp, "  ],\n  \"figures\": [\n");
+        for(std::size_t i = 0; i < figures.size(); i++)
+        {
+            const auto &[name, value, unit] = figures[i];
+            std::fprintf(fp, "    {\"name\": %s, \"value\": %.1f, "
+                         "\"unit\": %s}%s\n", quote(name).c_str(), value,
+                         quote(unit).c_str(),
+                         (i + 1 < figures.size()) ? "," : "");
+        }
+        std::fprintf(fp, "  ]\n}\n");
+        return std::fclose(fp) == 0;
+    }
+
+    // A made up table of n processes under init, each parented to a
+    // random earlier one, or the one before it (a chain), or init (a fan).
+    enum Shape
+    {
+        RANDOM,
+        CHAIN,
+        FAN,
+    };
+
+    std::map<int, gltop::Process> makeProcesses(int n, Shape shape = RANDOM)
+    {
+        std::mt19937 rng(n);
+        std::map<int, gltop::Process> processes;
+        gltop::ProcInfo info;
+        for(int pid = 1; pid <= n; pid++)
+        {
+            info.tid = pid;
+            if(pid == 1)
+                info.ppid = 0;
+            else if(shape == CHAIN)
+                info.ppid = pid - 1;
+            else if(shape == FAN)
+                info.ppid = 1;
+            else
+                info.ppid = std::uniform_int_distribution<int>(1, pid - 1)
+                    (rng);
+            info.vmRSS = static_cast<unsigned long>(rng() % 100000);
+            std::snprintf(info.cmd, sizeof(info.cmd), "worker%d", pid % 50);
+            processes.emplace(pid, gltop::Process(info, nullptr,
+                                                  gltop::TIER_HOT));
+        }
+        return processes;
+    }
+
+    // The tree as the table used to build it before the store: a list of
+    // children per process, each found by looking its parent up in the
+    // map. Kept as the baseline for "tree build store".
+    void linkChildren(const std::map<int, gltop::Process> &processes,
+                      std::map<int, std::vector<int>> &children)
+    {
+        // The lists lived in the processes, so only a new table costs
+        // allocations.
+        if(children.size() != processes.size())
+        {
+            children.clear();
+            for(auto &[pid, proc] : processes)
+                children[pid];
+        }
+        for(auto &[pid, list] : children)
+            list.clear();
+        for(auto &[pid, proc] : processes)
+        {
+            if(pid <= 2)
+                continue;
+            auto parent = children.find(proc.getPPID());
+            if(parent != children.end())
+                parent->second.push_back(pid);
+        }
+    }
+
+    // Tree build and a full pass over every process, with the processes
+    // in a map (how the table keeps them) and as columns.
+    void benchStore(int iterations, int n)
+    {
+        gltop::ProcessTable table;
+        table.getProcesses() = makeProcesses(n);
+        gltop::ProcessStore store;
+        std::string suffix = " " + std::to_string(n);
+
+        std::map<int, std::vector<int>> children;
+        report(("tree build map" + suffix).c_str(), run(iterations, [&]()
+        {
+            linkChildren(table.getProcesses(), children);
+            return children.size();
+        }));
+        report(("tree build store" + suffix).c_str(), run(iterations, [&]()
+        {
+            store.assign(table.getProcesses());
+            return store.size();
+        }));
+
+        std::size_t sum = 0;
+        report(("iterate map" + suffix).c_str(), run(iterations, [&]()
+        {
+            for(auto &[pid, proc] : table.getProcesses())
+                sum += proc.getRSS();
+            return table.getProcesses().size();
+        }));
+        report(("iterate store" + suffix).c_str(), run(iterations, [&]()
+        {
+            const auto &rss = store.getRSS();
+            for(std::size_t i = 0; i < store.size(); i++)
+                sum += rss[i];
+            return store.size();
+        }));
+
+        // Random lookups, half of them misses.
+        std::vector<int> lookups(4096);
+        std::mt19937 rng(1);
+        for(auto &pid : lookups)
+            pid = std::uniform_int_distribution<int>(1, 2 * n)(rng);
+        report(("pid lookups" + suffix).c_str(), run(iterations, [&]()
+        {
+            for(int pid : lookups)
+                sum += static_cast<std::size_t>(store.find(pid) + 1);
+            return lookups.size();
+        }));
+        auto map = table.getProcesses();
+        report(("map lookups" + suffix).c_str(), run(iterations, [&]()
+        {
+            for(int pid : lookups)
+                sum += map.count(pid);
+            return lookups.size();
+        }));
+
+        // Descendants of every process, as getNumChildrenAfter() counts
+        // them from the subtree sizes, and by walking each subtree.
+        report(("getNumChildrenAfter" + suffix).c_str(), run(iterations, [&]()
+        {
+            for(std::size_t i = 0; i < store.size(); i++)
+                sum += static_cast<std::size_t>
+                    (store.get(static_cast<int>(i)).getSubtreeSize() - 1);
+            return store.size();
+        }));
+        std::vector<int> stack;
+        report(("descendants walk" + suffix).c_str(), run(iterations, [&]()
+        {
+            for(std::size_t i = 0; i < store.size(); i++)
+            {
+                stack.assign(1, static_cast<int>(i));
+                while(!stack.empty())
+                {
+                    auto proc = store.get(stack.back());
+                    stack.pop_back();
+                    for(int child : proc.getChildren())
+                    {
+                        stack.push_back(child);
+                        sum++;
+                    }
+                }
+            }
+            return store.size();
+        }));
+
+        gltop::MapLayout layout;
+        report(("map layout" + suffix).c_str(), run(iterations, [&]()
+        {
+            layout.layout(store, store.getProcess(1));
+            return layout.getPositions().size();
+        }));
+
+        if(!sum)
+            std::printf("\n");
+    }
+
+    // Tree build plus the walk the renderer does for layout, on a
+    // degenerate tree.
+    void benchShape(int iterations, int n, Shape shape, const char *name)
+    {
+        auto processes = makeProcesses(n, shape);
+        gltop::ProcessStore store;
+        std::string suffix = std::string(" ") + name + " " + std::to_string(n);
+
+        report(("tree build" + suffix).c_str(), run(iterations, [&]()
+        {
+            store.assign(processes);
+            return store.size();
+        }));
+
+        gltop::MapLayout layout;
+        report(("map layout" + suffix).c_str(), run(iterations, [&]()
+        {
+            layout.layout(store, store.getProcess(1));
+            return layout.getPositions().size();
+        }));
+    }
+
+    // One second of a busy machine, as the recorder would see it: a
+    // couple of births and deaths (one birth reusing a dead pid), a tenth
+    // of the processes' CPU moving (in whole clock ticks), a twentieth of
+    // their RSS, and a few PSS and I/O changes.
+    void stepSession(gltop::RecordedSnapshot &snapshot, std::mt19937 &rng,
+                     int &nextPid)
+    {
+        auto &processes = snapshot.processes;
+        auto chance = [&](unsigned percent)
+        {
+            return rng() % 1000 < percent;
+        };
+        snapshot.sequence++;
+        snapshot.time += 1000;
+        snapshot.cpuBusy = static_cast<float>(rng() % 400) / 4.f;
+        snapshot.memAvailable += rng() % 2048 - 1024;
+        for(auto &proc : processes)
+        {
+            if(chance(100))
+                proc.cpu = static_cast<float>(rng() % 100);
+            if(chance(50))
+                proc.rss += (rng() % 64 - 32) * 4;
+            if(chance(10))
+            {
+                proc.pss = proc.rss / 2 + rng() % 256 * 4;
+                proc.uss = proc.pss / 2;
+            }
+            if(chance(20))
+                proc.ioRead = static_cast<float>(rng() % 65536) * 512.f;
+        }
+        int deadPid = nextPid++;
+        for(int i = 0; i < 2 && processes.size() > 1; i++)
+        {
+            auto dead = processes.begin() + 1
+                + rng() % (processes.size() - 1);
+            deadPid = dead->pid;
+            processes.erase(dead);
+        }
+        for(int pid : {deadPid, nextPid++})
+        {
+            auto at = std::lower_bound(processes.begin(), processes.end(),
+                                       pid, [](const auto &proc, int pid)
+            {
+                return proc.pid < pid;
+            });
+            gltop::RecordedProcess proc;
+            proc.pid = pid;
+            proc.ppid = processes[rng() % processes.size()].pid;
+            proc.startTime = static_cast<unsigned long long>
+                (snapshot.time / 10);
+            proc.name = "worker" + std::to_string(pid % 50);
+            proc.rss = rng() % 100000;
+            proc.vsz = proc.rss * 4;
+            proc.numThreads = 1;
+            processes.insert(at, std::move(proc));
+        }
+    }
+
+    // The session recorder: taking a snapshot, encoding a second of
+    // changes, and the size of an hour's log.
+    void benchRecord(int iterations, int n)
+    {
+        gltop::ProcessTable table;
+        table.getProcesses() = makeProcesses(n);
+        gltop::ProcessStore store;
+        store.assign(table.getProcesses());
+        gltop::SystemStats system;
+        std::string suffix = " " + std::to_string(n);
+
+        gltop::RecordedSnapshot snapshot;
+        report(("record assign" + suffix).c_str(), run(iterations, [&]()
+        {
+            snapshot.assign(store, system, 1);
+            return snapshot.processes.size();
+        }));
+
+        std::mt19937 rng(n);
+        int nextPid = n + 1;
+        gltop::SessionEncoder encoder;
+        std::vector<std::uint8_t> record;
+        encoder.encode(snapshot, record);
+        report(("record tick" + suffix).c_str(), run(iterations, [&]()
+        {
+            stepSession(snapshot, rng, nextPid);
+            record.clear();
+            encoder.encode(snapshot, record);
+            return snapshot.processes.size();
+        }));
+
+        // A fresh hour, at one snapshot a second.
+        snapshot.assign(store, system, 1);
+        encoder.reset();
+        std::size_t bytes = gltop::SessionEncoder::MAGIC_SIZE;
+        std::size_t keyframeBytes = 0;
+        for(int tick = 0; tick < 3600; tick++)
+        {
+            record.clear();
+            encoder.encode(snapshot, record);
+            if(record[0] == gltop::SessionEncoder::KEYFRAME)
+                keyframeBytes += record.size();
+            bytes += record.size();
+            stepSession(snapshot, rng, nextPid);
+        }
+        reportFigure(("session log" + suffix).c_str(),
+                     static_cast<double>(bytes) / (1 << 20), "MB/hour");
+        reportFigure(("session keyframes" + suffix).c_str(),
+                     static_cast<double>(keyframeBytes) / (1 << 20),
+                     "MB/hour");
+    }
+
+    bool sameSnapshot(const gltop::RecordedSnapshot &a,
+                      const gltop::RecordedSnapshot &b)
+    {
+        auto sameProcess = [](const gltop::RecordedProcess &p,
+                              const gltop::RecordedProcess &q)
+        {
+            return p.pid == q.pid && p.ppid == q.ppid
+                && p.startTime == q.startTime && p.name == q.name
+                && p.rss == q.rss && p.vsz == q.vsz && p.pss == q.pss
+                && p.uss == q.uss && p.numThreads == q.numThreads
+                && p.cpu == q.cpu && p.ioRead == q.ioRead
+                && p.ioWrite == q.ioWrite;
+        };
+        return a.sequence == b.sequence && a.time == b.time
+            && a.cpuBusy == b.cpuBusy && a.load == b.load
+            && a.memAvailable == b.memAvailable
+            && std::equal(a.processes.begin(), a.processes.end(),
+                          b.processes.begin(), b.processes.end(),
+                          sameProcess);
+    }
+
+    // Record two sessions to one log, the first cut short mid-record as
+    // a crash would leave it, and check every complete snapshot reads
+    // back as it went in: keyframes, deltas, reused pids and all.
+    bool checkRecord(const fs::path &dir)
+    {
+        fs::path path = dir / "bench.rec";
+        gltop::ProcessTable table;
+        table.getProcesses() = makeProcesses(1000);
+        gltop::ProcessStore store;
+        store.assign(table.getProcesses());
+        gltop::RecordedSnapshot snapshot;
+        snapshot.assign(store, gltop::SystemStats(), 1);
+        std::mt19937 rng(1);
+        int nextPid = 1001;
+
+        std::vector<gltop::RecordedSnapshot> expected;
+        auto recordSession = [&](int ticks)
+        {
+            gltop::SessionRecorder recorder(path.string());
+            for(int tick = 0; tick < ticks; tick++)
+            {
+                recorder.record(snapshot);
+                expected.push_back(snapshot);
+                stepSession(snapshot, rng, nextPid);
+            }
+        };
+        recordSession(gltop::SessionEncoder::KEYFRAME_INTERVAL * 2 + 100);
+        fs::resize_file(path, fs::file_size(path) - 5);
+        expected.pop_back();
+        recordSession(100);
+
+        std::size_t decoded = 0;
+        gltop::SessionDecoder decoder(path.string());
+        while(decoder.next())
+        {
+            if(decoded == expected.size()
+               || !sameSnapshot(decoder.get(), expected[decoded]))
+                break;
+            decoded++;
+        }
+        std::printf("%-28s %10zu of %zu snapshots\n", "session log round trip",
+                    decoded, expected.size());
+        return decoded == expected.size();
+    }
+
+    // A process's stat as a synthetic procfs under root would have it,
+    // with value kB of VSZ and value pages of RSS.
+    void writeStat(const fs::path &root, int pid, unsigned long value)
+    {
+        fs::create_directories(root / std::to_string(pid));
+        std::ofstream(root / std::to_string(pid) / "stat")
+            << pid << " (hist) S 1 " << pid << ' ' << pid
+            << " 0 -1 4194560 0 0 0 0 0 0 0 0 20 0 1 0 100 "
+            << value * 1024 << ' ' << value
+            << " 18446744073709551615 1 1 0 0 0 0 0 0 0 0 0 0 17 0 0 0 0 0"
+            " 0 0 0 0 0 0 0 0 0\n";
+    }
+
+    // Whether history for proc holds the values first, first + 1, ...
+    // first + count - 1, oldest first, in both memory metrics.
+    bool hasHistory(const gltop::History &history,
+                    const gltop::Process &proc, unsigned long first,
+                    std::size_t count)
+    {
+        unsigned long pageKB = static_cast<unsigned long>
+            (sysconf(_SC_PAGESIZE) / 1024);
+        std::vector<float> rss(history.getDepth());
+        std::vector<float> vsz(history.getDepth());
+        int slot = proc.getHistorySlot();
+        if(history.read(slot, gltop::History::RSS, rss.data(), rss.size())
+           != count
+           || history.read(slot, gltop::History::VSZ, vsz.data(), vsz.size())
+           != count)
+            return false;
+        for(std::size_t k = 0; k < count; k++)
+            if(rss[k] != static_cast<float>((first + k) * pageKB)
+               || vsz[k] != static_cast<float>(first + k))
+                return false;
+        return true;
+    }
+
+    // Append more samples than the history holds for one process, then
+    // let another take its slot, and check each reads back its newest
+    // samples oldest first and nothing of the other's.
+    bool checkHistory(const fs::path &dir)
+    {
+        fs::path root = dir / "proc";
+        fs::create_directories(root);
+        std::ofstream(root / "uptime") << "1000.00 1000.00\n";
+        gltop::ProcessTable table
+            (std::make_shared<gltop::ProcReader>(root.string()));
+        gltop::History history(8, 8 * gltop::History::SAMPLE_BYTES);
+        std::size_t depth = history.getDepth();
+
+        int samples = static_cast<int>(depth) * 2 + 3;
+        for(int i = 0; i < samples; i++)
+        {
+            writeStat(root, 100, 1000 + i);
+            table.refresh();
+            history.append(table.getProcesses());
+        }
+        bool wrapped = hasHistory(history, table.getProcesses().at(100),
+                                  1000 + samples - (depth - 1), depth - 1);
+
+        // The one slot is still taken when 200 first shows up, so 200 gets
+        // it from the sample after.
+        fs::remove_all(root / "100");
+        for(int i = 0; i < 4; i++)
+        {
+            writeStat(root, 200, 5000 + i);
+            table.refresh();
+            history.append(table.getProcesses());
+        }
+        bool reused = hasHistory(history, table.getProcesses().at(200), 5001,
+                                 3);
+
+        std::printf("%-28s %10s wrapped, %s reused\n", "history ring",
+                    wrapped ? "ok" : "BAD", reused ? "ok" : "BAD");
+        return wrapped && reused;
+    }
+
+    // With no budget left, a priority process is still read, and nothing
+    // else is.
+    bool checkMemoryPriority(std::map<int, gltop::Process> &processes,
+                             const std::string &root)
+    {
+        gltop::ProcReader reader(root);
+        gltop::MemoryDetail detail;
+        gltop::Process *priority = nullptr;
+        for(auto &[pid, proc] : processes)
+        {
+            if(proc.getVMem() != 0 && reader.readSmapsRollup(pid, detail))
+            {
+                priority = &proc;
+                break;
+            }
+        }
+        if(!priority)
+        {
+            std::cerr << "No smaps_rollup to read, skipping the PSS "
+                "priority check.\n";
+            return true;
+        }
+
+        gltop::MemoryAccounting memory;
+        memory.setProcRoot(root);
+        memory.setPriority(priority->getTID(), true);
+        memory.sample(processes, chron::nanoseconds(-1));
+        bool ok = priority->getMemoryAge() == 0 && memory.getLastRead() == 1;
+        std::printf("%-28s %10zu read, pid %d %s\n", "PSS priority, no budget",
+                    memory.getLastRead(), priority->getTID(),
+                    ok ? "read" : "NOT read");
+        return ok;
+    }
+
+    // A sphere of slices by stacks quads, with texture coordinates and
+    // normals, as an .obj at path.
+    void writeSphere(const fs::path &path, int slices, int stacks)
+    {
+        std::ofstream obj(path);
+        for(int j = 0; j <= stacks; j++)
+            for(int i = 0; i <= slices; i++)
+            {
+                float u = static_cast<float>(i) / static_cast<float>(slices);
+                float v = static_cast<float>(j) / static_cast<float>(stacks);
+                float theta = u * 6.2831853f;
+                float phi = v * 3.1415927f;
+                float x = std::sin(phi) * std::cos(theta);
+                float y = std::cos(phi);
+                float z = std::sin(phi) * std::sin(theta);
+                obj << "v " << x << ' ' << y << ' ' << z << '\n'
+                    << "vt " << u << ' ' << v << '\n'
+                    << "vn " << x << ' ' << y << ' ' << z << '\n';
+            }
+        for(int j = 0; j < stacks; j++)
+            for(int i = 0; i < slices; i++)
+            {
+                int a = j * (slices + 1) + i + 1;
+                int b = a + slices + 1;
+                obj << "f " << a << '/' << a << '/' << a << ' '
+                    << b << '/' << b << '/' << b << ' '
+                    << b + 1 << '/' << b + 1 << '/' << b + 1 << ' '
+                    << a + 1 << '/' << a + 1 << '/' << a + 1 << '\n';
+            }
+    }
+
+    // A size by size 24 bit gradient as a .bmp at path.
+    void writeBmp(const fs::path &path, int size)
+    {
+        int rowBytes = (3 * size + 3) / 4 * 4;
+        std::vector<unsigned char> data(static_cast<std::size_t>(54
+                                                                 + rowBytes
+                                                                 * size));
+        auto put = [&](std::size_t at, unsigned value, int bytes)
+        {
+            for(int i = 0; i < bytes; i++)
+                data[at + i] = static_cast<unsigned char>(value >> (8 * i));
+        };
+        put(0, 0x4d42, 2);
+        put(2, static_cast<unsigned>(data.size()), 4);
+        put(10, 54, 4);
+        put(14, 40, 4);
+        put(18, static_cast<unsigned>(size), 4);
+        put(22, static_cast<unsigned>(size), 4);
+        put(26, 1, 2);
+        put(28, 24, 2);
+        for(int t = 0; t < size; t++)
+            for(int s = 0; s < size; s++)
+            {
+                std::size_t at = 54 + static_cast<std::size_t>(t * rowBytes
+                                                               + 3 * s);
+                data[at] = static_cast<unsigned char>(s);
+                data[at + 1] = static_cast<unsigned char>(t);
+                data[at + 2] = static_cast<unsigned char>(s ^ t);
+            }
+        std::ofstream(path, std::ios::binary)
+            .write(reinterpret_cast<const char *>(data.data()),
+                   static_cast<std::streamsize>(data.size()));
+    }
+
+#ifdef GLTOP_HAVE_EGL
+    // An offscreen OpenGL compatibility context, current on this thread
+    // until destroyed. Throws if EGL has no display or config for it.
+    class HeadlessContext
+    {
+    public:
+        HeadlessContext(int width, int height)
+            : mDisplay(EGL_NO_DISPLAY),mContext(EGL_NO_CONTEXT),
+              mSurface(EGL_NO_SURFACE)
+        {
+            // Surfaceless first, so no X server is needed.
+            auto getPlatformDisplay
+                = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>
+                (eglGetProcAddress("eglGetPlatformDisplayEXT"));
+            if(getPlatformDisplay)
+                mDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                              EGL_DEFAULT_DISPLAY, nullptr);
+            if(mDisplay == EGL_NO_DISPLAY)
+                mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+            if(mDisplay == EGL_NO_DISPLAY
+               || !eglInitialize(mDisplay, nullptr, nullptr))
+                throw std::runtime_error("No EGL display");
+
+            const EGLint configAttribs[] =
+            {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+                EGL_DEPTH_SIZE, 24,
+                EGL_NONE,
+            };
+            const EGLint surfaceAttribs[] =
+            {
+                EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE,
+            };
+            EGLConfig config;
+            EGLint configs = 0;
+            if(!eglChooseConfig(mDisplay, configAttribs, &config, 1,
+                                &configs) || configs < 1
+               || !eglBindAPI(EGL_OPENGL_API))
+            {
+                eglTerminate(mDisplay);
+                throw std::runtime_error("No EGL config for OpenGL");
+            }
+            mSurface = eglCreatePbufferSurface(mDisplay, config,
+                                               surfaceAttribs);
+            mContext = eglCreateContext(mDisplay, config, EGL_NO_CONTEXT,
+                                        nullptr);
+            if(mSurface == EGL_NO_SURFACE || mContext == EGL_NO_CONTEXT
+               || !eglMakeCurrent(mDisplay, mSurface, mSurface, mContext))
+            {
+                destroy();
+                throw std::runtime_error("Could not make an EGL context");
+            }
+        }
+
+        ~HeadlessContext()
+        {
+            destroy();
+        }
+
+        HeadlessContext(const HeadlessContext &) = delete;
+        HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+        std::string getRenderer() const
+        {
+            auto renderer = glGetString(GL_RENDERER);
+            return renderer ? reinterpret_cast<const char *>(renderer) : "";
+        }
+
+    private:
+        void destroy()
+        {
+            eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                           EGL_NO_CONTEXT);
+            if(mContext != EGL_NO_CONTEXT)
+                eglDestroyContext(mDisplay, mContext);
+            if(mSurface != EGL_NO_SURFACE)
+                eglDestroySurface(mDisplay, mSurface);
+            eglTerminate(mDisplay);
+        }
+
+        EGLDisplay mDisplay;
+        EGLContext mContext;
+        EGLSurface mSurface;
+    };
+
+    constexpr int FRAME_WIDTH = 1280;
+    constexpr int FRAME_HEIGHT = 720;
+
+    // Compile the .obj at path into a display list, the way gltop loads
+    // its models.
+    GLuint loadModel(const fs::path &path)
+    {
+        GLuint list = glGenLists(1);
+        glNewList(list, GL_COMPILE);
+        LoadObjFile(path.c_str(), 1.f);
+        glEndList();
+        return list;
+    }
+
+    // One frame of the map: the model at every position, tinted, and the
+    // line through them, like drawMap() and drawMapPts() minus the text.
+    // Waits for the renderer to finish.
+    void drawFrame(const std::vector<gltop::MapPoint> &positions,
+                   GLuint model)
+    {
+        glViewport(0, 0, FRAME_WIDTH, FRAME_HEIGHT);
+        glClearColor(0.f, 0.f, 0.f, 1.f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_DEPTH_TEST);
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glFrustum(-1., 1., -0.5625, 0.5625, 1., 10000.);
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+        glTranslatef(0.f, 0.f, -400.f);
+        glRotatef(30.f, 1.f, 0.f, 0.f);
+
+        float heat = 0.f;
+        for(const auto &pos : positions)
+        {
+            glPushMatrix();
+            glTranslatef(pos.x, pos.y, pos.z);
+            glScalef(5.f, 5.f, 5.f);
+            heat = (heat > 1.f) ? 0.f : heat + 0.01f;
+            glColor3f(1.f, 1.f - heat, 1.f - heat);
+            glCallList(model);
+            glPopMatrix();
+        }
+        glBegin(GL_LINE_STRIP);
+        glColor3f(1.f, 1.f, 1.f);
+        for(const auto &pos : positions)
+            glVertex3f(pos.x, pos.y, pos.z);
+        glEnd();
+        glFinish();
+    }
+#endif
+
+    // The texture and model loaders on made up files, and, with EGL,
+    // whole frames of the map at each size.
+    void benchRender(int iterations, const fs::path &dir,
+                     std::string &renderer)
+    {
+        fs::path bmp = dir / "bench.bmp";
+        fs::path obj = dir / "bench.obj";
+        fs::path smallObj = dir / "bench_small.obj";
+        writeBmp(bmp, 1024);
+        writeSphere(obj, 128, 64);
+        writeSphere(smallObj, 16, 8);
+
+        report("BmpToTexture 1024", run(iterations, [&]()
+        {
+            int width = 0;
+            int height = 0;
+            delete[] BmpToTexture(bmp.c_str(), &width, &height);
+            return static_cast<std::size_t>(width * height);
+        }));
+
+#ifdef GLTOP_HAVE_EGL
+        std::unique_ptr<HeadlessContext> context;
+        try
+        {
+            context = std::make_unique<HeadlessContext>(FRAME_WIDTH,
+                                                        FRAME_HEIGHT);
+        }
+        catch(const std::runtime_error &e)
+        {
+            std::cerr << e.what() << ", skipping the OpenGL benchmarks.\n";
+            return;
+        }
+        renderer = context->getRenderer();
+        std::printf("%-28s %s\n", "renderer", renderer.c_str());
+
+        report("LoadObjFile 8k quads", run(iterations, [&]()
+        {
+            glDeleteLists(loadModel(obj), 1);
+            return std::size_t(128 * 64);
+        }));
+
+        GLuint model = loadModel(smallObj);
+        gltop::ProcessStore store;
+        gltop::MapLayout layout;
+        for(int n : {1000, 10000})
+        {
+            store.assign(makeProcesses(n));
+            layout.layout(store, store.getProcess(1));
+            report(("frame " + std::to_string(n)).c_str(),
+                   run(std::max(iterations / 5, 1), [&]()
+            {
+                drawFrame(layout.getPositions(), model);
+                return layout.getPositions().size();
+            }));
+        }
+        glDeleteLists(model, 1);
+#else
+        (void)renderer;
+        std::cerr << "EGL not found, skipping the OpenGL benchmarks.\n";
+#endif
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = 50;
+    std::string root = gltop::ProcReader::DEFAULT_ROOT;
+    std::string cgroupRoot = gltop::CgroupTable::DEFAULT_ROOT;
+    std::string jsonPath;
+    int positional = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if(arg == "--json" && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if(arg == "--cgroup-root" && i + 1 < argc)
+            cgroupRoot = argv[++i];
+        else if(positional == 0)
+        {
+            iterations = std::atoi(argv[i]);
+            positional++;
+        }
+        else if(positional == 1)
+        {
+            root = arg;
+            positional++;
+        }
+        else
+            std::cerr << "Don't know what to do with argument '" << arg
+                      << "'\n";
+    }
+    if(iterations <= 0)
+        iterations = 1;
+
+    gltop::ProcReader reader(root);
+    gltop::ProcInfo info;
+    report("ProcReader all tiers", run(iterations, [&]()
+    {
+        std::size_t n = 0;
+        for(int pid : reader.scanPids())
+            n += reader.read(pid, gltop::TIER_HOT | gltop::TIER_WARM
+                             | gltop::TIER_COLD, info);
+        return n;
+    }));
+    report("ProcReader hot tier", run(iterations, [&]()
+    {
+        std::size_t n = 0;
+        for(int pid : reader.scanPids())
+            n += reader.read(pid, gltop::TIER_HOT, info);
+        return n;
+    }));
+
+    auto shared = std::make_shared<gltop::ProcReader>(root);
+    report("Proctab", run(iterations, [&]()
+    {
+        std::size_t n = 0;
+        gltop::Proctab tab(shared);
+        for(auto proc = tab.getNextProcess(); proc;
+            proc = tab.getNextProcess())
+            n++;
+        return n;
+    }));
+
+    // Filters that match next to nothing, so this is the cost of rejecting.
+    report("Proctab user filter", run(iterations, [&]()
+    {
+        std::size_t n = 0;
+        gltop::Proctab tab(shared, "65534", "");
+        for(auto proc = tab.getNextProcess(); proc;
+            proc = tab.getNextProcess())
+            n++;
+        return n;
+    }));
+    report("Proctab name filter", run(iterations, [&]()
+    {
+        std::size_t n = 0;
+        gltop::Proctab tab(shared, "", "gltop_bench");
+        for(auto proc = tab.getNextProcess(); proc;
+            proc = tab.getNextProcess())
+            n++;
+        return n;
+    }));
+
+    gltop::ProcessTable table(shared);
+    report("ProcessTable refresh", run(iterations, [&]()
+    {
+        table.refresh();
+        return table.getProcesses().size();
+    }));
+
+    // The same filters kept across refreshes, where the verdicts are too.
+    gltop::ProcessTable userFiltered(shared);
+    userFiltered.setFilter(gltop::ProcFilter("65534", ""));
+    report("ProcessTable user filter", run(iterations, [&]()
+    {
+        userFiltered.refresh();
+        return userFiltered.getProcesses().size();
+    }));
+    gltop::ProcessTable nameFiltered(shared);
+    nameFiltered.setFilter(gltop::ProcFilter("", "gltop_bench"));
+    report("ProcessTable name filter", run(iterations, [&]()
+    {
+        nameFiltered.refresh();
+        return nameFiltered.getProcesses().size();
+    }));
+
+    // What the collector and the render thread do per scan before any GL:
+    // scan, build the tree, lay out the map.
+    gltop::ProcessStore scanStore;
+    gltop::MapLayout scanLayout;
+    report("scan to layout", run(iterations, [&]()
+    {
+        table.refresh();
+        scanStore.assign(table.getProcesses());
+        scanLayout.layout(scanStore, scanStore.getProcess(1));
+        return scanStore.size();
+    }));
+
+    // Names for every process; after the warm up these are cache hits.
+    report("user/group names", run(iterations, [&]()
+    {
+        std::size_t n = 0;
+        for(auto &[pid, proc] : table.getProcesses())
+            n += !proc.getUserName().empty() && !proc.getGroupName().empty();
+        return n;
+    }));
+
+    // Per frame label lookups should not allocate.
+    report("basenames", run(iterations, [&]()
+    {
+        std::size_t n = 0;
+        for(auto &[pid, proc] : table.getProcesses())
+            n += !proc.getBasename().empty();
+        return n;
+    }));
+
+    // How much the pool saves on command lines.
+    std::size_t cmdlineBytes = 0;
+    for(auto &[pid, proc] : table.getProcesses())
+        cmdlineBytes += proc.getCmdline().size();
+    auto &pool = gltop::StringPool::get();
+    std::printf("%-28s %10zu bytes %10zu pooled in %zu strings\n",
+                "command lines", cmdlineBytes, pool.getBytes(), pool.size());
+
+    gltop::ProcessTable threaded(shared);
+    threaded.setThreadMode(true);
+    report("refresh with threads", run(iterations, [&]()
+    {
+        threaded.refresh();
+        std::size_t n = 0;
+        for(auto &[pid, proc] : threaded.getProcesses())
+            n += std::max<std::size_t>(proc.getThreads().size(), 1);
+        return n;
+    }));
+
+    gltop::History history(60, 32u << 20);
+    report("History append", run(iterations, [&]()
+    {
+        history.append(table.getProcesses());
+        return table.getProcesses().size();
+    }));
+
+    // /proc/<pid>/io for every process each time.
+    gltop::IoAccounting io;
+    io.setProcRoot(root);
+    io.setInterval(chron::milliseconds(0));
+    report("I/O rates", run(iterations, [&]()
+    {
+        io.sample(table.getProcesses());
+        return io.getLastRead();
+    }));
+
+    // smaps_rollup for everything, then on a 1ms budget per refresh.
+    bool memoryOk = checkMemoryPriority(table.getProcesses(), root);
+    gltop::MemoryAccounting memory;
+    memory.setProcRoot(root);
+    report("PSS all", run(iterations, [&]()
+    {
+        memory.sample(table.getProcesses(), chron::seconds(1));
+        return memory.getLastRead();
+    }));
+    report("PSS 1ms budget", run(iterations, [&]()
+    {
+        memory.sample(table.getProcesses(), chron::milliseconds(1));
+        return memory.getLastRead();
+    }));
+
+    // Cgroup totals after the first pass, when every pid's cgroup is
+    // cached and only the controller files are read.
+    gltop::CgroupTable cgroupTable(cgroupRoot, root);
+    report("CgroupTable refresh", run(iterations, [&]()
+    {
+        cgroupTable.refresh(table.getProcesses());
+        return cgroupTable.getCgroups().size();
+    }));
+
+    // The held fds against opening and parsing /proc/meminfo with streams.
+    gltop::SystemSampler sampler(root);
+    gltop::SystemStats stats;
+    report("SystemSampler", run(iterations, [&]()
+    {
+        sampler.sample(stats);
+        return stats.cpus.size() + 1;
+    }));
+    report("meminfo ifstream", run(iterations, [&]()
+    {
+        std::ifstream meminfo(root + "/meminfo");
+        std::string key;
+        unsigned long value = 0;
+        std::size_t n = 0;
+        while(meminfo >> key >> value)
+        {
+            meminfo.ignore(64, '\n');
+            n++;
+        }
+        return n;
+    }));
+    std::printf("%-28s %10lu kB total %10lu kB available, load %.2f\n",
+                "", stats.memTotal, stats.memAvailable, stats.load[0]);
+
+    // Scan throughput as the reads are split across more threads.
+    unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<unsigned> threadCounts;
+    for(unsigned threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+    for(unsigned threads : threadCounts)
+    {
+        gltop::ProcessTable parallel
+            (std::make_shared<gltop::ProcReader>(root), threads);
+        auto r = run(iterations, [&]()
+        {
+            parallel.refresh();
+            return parallel.getProcesses().size();
+        });
+        std::string name = "refresh x" + std::to_string(threads);
+        report(name.c_str(), r);
+        std::printf("%-28s %10.0f tasks/s\n", "",
+                    static_cast<double>(r.tasks) * 1000. / r.msPerIter);
+    }
+
+    benchStore(iterations, 10000);
+    benchStore(std::max(iterations / 10, 1), 100000);
+    benchShape(std::max(iterations / 10, 1), 100000, CHAIN, "chain");
+    benchShape(std::max(iterations / 10, 1), 100000, FAN, "fan");
+    benchRecord(iterations, 10000);
+
+    std::string renderer;
+    fs::path dir = fs::temp_directory_path()
+        / ("gltop_bench." + std::to_string(getpid()));
+    fs::create_directories(dir);
+    benchRender(iterations, dir, renderer);
+    bool recordOk = checkRecord(dir);
+    bool historyOk = checkHistory(dir);
+    fs::remove_all(dir);
+
+#ifdef GLTOP_HAVE_PROCPS
+    report("libprocps readproc", run(iterations, []()
+    {
+        std::size_t n = 0;
+        PROCTAB *tab = openproc(PROC_FILLMEM | PROC_FILLUSR | PROC_FILLGRP
+                                | PROC_FILLARG | PROC_FILLSTATUS
+                                | PROC_FILLSTAT);
+        while(proc_t *proc = readproc(tab, nullptr))
+        {
+            freeproc(proc);
+            n++;
+        }
+        closeproc(tab);
+        return n;
+    }));
+#else
+    std::cerr << "libprocps not found, skipping the readproc comparison.\n";
+#endif
+
+    if(!jsonPath.empty() && !writeJson(jsonPath, iterations, root, renderer))
+    {
+        std::cerr << "Could not write " << jsonPath << "\n";
+        return 1;
+    }
+    if(!recordOk)
+    {
+        std::cerr << "Session log did not read back as recorded.\n";
+        return 1;
+    }
+    if(!historyOk)
+    {
+        std::cerr << "History did not read back as appended.\n";
+        return 1;
+    }
+    if(!memoryOk)
+    {
+        std::cerr << "A priority process's PSS was not read without a "
+            "budget.\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,8 @@
+#ifndef BMPTOTEXTURE_H
+#define BMPTOTEXTURE_H
+
+// Read a 24 bit or 256 colour uncompressed BMP into rows of RGB bytes,
+// bottom to top. The caller delete[]s the result; NULL on failure.
+unsigned char *BmpToTexture(const char *filename, int *width, int *height);
+
+#endif /* BMPTOTEXTURE_H */
@@ -0,0 +1,191 @@
+extern "C" {
+#include <unistd.h>
+#include <fcntl.h>
+}
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "cgroup.hpp"
+#include "gltop.hpp"
+
+namespace
+{
+    // Path of the cgroup above path ("/" for the top level, empty for the
+    // root itself).
+    std::string_view getParentPath(std::string_view path)
+    {
+        auto slash = path.rfind('/');
+        if(slash == std::string_view::npos || path.size() <= 1)
+            return std::string_view();
+        return slash ? path.substr(0, slash) : path.substr(0, 1);
+    }
+}
+
+gltop::CgroupReader::CgroupReader(const std::string &root)
+    : mRootFd(open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)),
+      mPath(),mBuf()
+{
+}
+
+gltop::CgroupReader::~CgroupReader()
+{
+    if(mRootFd >= 0)
+        close(mRootFd);
+}
+
+long gltop::CgroupReader::readFile(const std::string &path, const char *name)
+{
+    // Paths are relative to the root fd.
+    auto start = path.find_first_not_of('/');
+    if(start == std::string::npos)
+        mPath.assign(name);
+    else
+    {
+        mPath.assign(path, start, std::string::npos);
+        mPath += '/';
+        mPath += name;
+    }
+    int fd = openat(mRootFd, mPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return -1;
+    ssize_t len = pread(fd, mBuf, sizeof(mBuf) - 1, 0);
+    close(fd);
+    if(len < 0)
+        return -1;
+    mBuf[len] = '\0';
+    return len;
+}
+
+bool gltop::CgroupReader::read(const std::string &path, CgroupStats &stats)
+{
+    stats = CgroupStats();
+    if(mRootFd < 0)
+        return false;
+
+    // Every cgroup has cpu.stat, whatever controllers are enabled.
+    if(readFile(path, "cpu.stat") < 0)
+        return false;
+    if(auto usage = std::strstr(mBuf, "usage_usec "))
+        stats.usageUsec = std::strtoull(usage + 11, nullptr, 10);
+
+    if(readFile(path, "memory.current") > 0)
+        stats.memory = std::strtoull(mBuf, nullptr, 10);
+    if(readFile(path, "pids.current") > 0)
+        stats.pids = std::strtoull(mBuf, nullptr, 10);
+    return true;
+}
+
+gltop::CgroupTable::CgroupTable(const std::string &root,
+                                const std::string &procRoot)
+    : mReader(procRoot),mStats(root),mNodes(),mMembers(),mGeneration(0),
+      mCgroups(),mLastTime(),mPath(),mChildCounts()
+{
+}
+
+void gltop::CgroupTable::refresh(const std::map<int, Process> &processes)
+{
+    auto now = std::chrono::steady_clock::now();
+    mGeneration++;
+    for(auto &[path, node] : mNodes)
+    {
+        node.pids.clear();
+        node.live = false;
+    }
+
+    // Place each process, reading /proc only for ones not seen before.
+    for(auto &[pid, proc] : processes)
+    {
+        auto &member = mMembers[pid];
+        if(!member.node || member.startTime != proc.getStartTime())
+        {
+            if(!mReader.readCgroup(pid, mPath))
+                mPath.assign("/");
+            member.startTime = proc.getStartTime();
+            member.node = &mNodes.try_emplace(mPath).first->second;
+        }
+        member.generation = mGeneration;
+        member.node->pids.push_back(pid);
+    }
+    for(auto it = mMembers.begin(); it != mMembers.end();)
+    {
+        if(it->second.generation != mGeneration)
+            it = mMembers.erase(it);
+        else
+            ++it;
+    }
+
+    // Keep the cgroups with processes and everything above them.
+    for(auto it = mNodes.begin(); it != mNodes.end(); ++it)
+    {
+        if(it->second.pids.empty())
+            continue;
+        it->second.live = true;
+        for(auto parent = getParentPath(it->first); !parent.empty();
+            parent = getParentPath(parent))
+        {
+            auto &node = mNodes.try_emplace(std::string(parent)).first->second;
+            if(node.live)
+                break;
+            node.live = true;
+        }
+    }
+    for(auto it = mNodes.begin(); it != mNodes.end();)
+    {
+        if(!it->second.live)
+            it = mNodes.erase(it);
+        else
+            ++it;
+    }
+
+    // Sorted by path, so a parent is always filled in before its children.
+    long cpus = std::max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+    double elapsedUsec = std::chrono::duration<double, std::micro>
+        (now - mLastTime).count() * static_cast<double>(cpus);
+    bool hasElapsed = mLastTime.time_since_epoch().count() != 0
+        && elapsedUsec > 0.;
+    mChildCounts.assign(mNodes.size(), 0);
+    mCgroups.resize(mNodes.size());
+    int index = 0;
+    for(auto &[path, node] : mNodes)
+    {
+        auto &cgroup = mCgroups[index];
+        node.index = index;
+        cgroup.path = path;
+        cgroup.pids = node.pids;
+
+        auto parentPath = getParentPath(path);
+        auto parent = parentPath.empty() ? mNodes.end()
+            : mNodes.find(parentPath);
+        if(parent != mNodes.end())
+        {
+            cgroup.parent = parent->second.index;
+            cgroup.depth = mCgroups[cgroup.parent].depth + 1;
+            cgroup.siblingIndex = mChildCounts[cgroup.parent]++;
+        }
+        else
+        {
+            cgroup.parent = -1;
+            cgroup.depth = 0;
+            cgroup.siblingIndex = 0;
+        }
+
+        cgroup.cpu = 0.f;
+        if(mStats.read(path, cgroup.stats))
+        {
+            if(node.hasUsage && hasElapsed
+               && cgroup.stats.usageUsec >= node.lastUsage)
+                cgroup.cpu = static_cast<float>
+                    (100. * static_cast<double>(cgroup.stats.usageUsec
+                                                - node.lastUsage)
+                     / elapsedUsec);
+            node.lastUsage = cgroup.stats.usageUsec;
+            node.hasUsage = true;
+        }
+        else
+            node.hasUsage = false;
+        index++;
+    }
+    mLastTime = now;
+}
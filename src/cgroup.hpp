@@ -0,0 +1,154 @@
+#ifndef GLTOP_CGROUP_HPP
+#define GLTOP_CGROUP_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "procfs.hpp"
+
+namespace gltop
+{
+    class Process;
+
+    // Controller figures of one cgroup. Like the files they come from they
+    // include everything below the cgroup, so nothing needs summing.
+    struct CgroupStats
+    {
+        // usage_usec from cpu.stat.
+        unsigned long long usageUsec = 0;
+        // memory.current, in bytes.
+        unsigned long long memory = 0;
+        // pids.current.
+        unsigned long long pids = 0;
+    };
+
+    // A cgroup that has processes in it or below it.
+    struct Cgroup
+    {
+        // Path under the cgroup2 mount, "/" for the root.
+        std::string path;
+        // Index of the parent in the list (-1 for the top), how far below
+        // the top it is, and its place among its parent's children.
+        int parent = -1;
+        int depth = 0;
+        int siblingIndex = 0;
+        CgroupStats stats;
+        // CPU use (% of all CPUs) since the previous refresh.
+        float cpu = 0.f;
+        // Processes directly in this cgroup, sorted.
+        std::vector<int> pids;
+
+        // Last component of the path ("foo.service").
+        inline std::string_view getName() const
+        {
+            std::string_view name(path);
+            auto slash = name.rfind('/');
+            if(slash != std::string_view::npos && name.size() > 1)
+                name.remove_prefix(slash + 1);
+            return name;
+        }
+    };
+
+    // Reads the controller files of cgroups under a cgroup2 mount (or any
+    // directory laid out like one), relative to a directory fd held open
+    // on it.
+    class CgroupReader
+    {
+    public:
+        CgroupReader(const std::string &root);
+
+        ~CgroupReader();
+
+        CgroupReader(const CgroupReader &) = delete;
+        CgroupReader &operator=(const CgroupReader &) = delete;
+
+        inline bool isOpen() const
+        {
+            return mRootFd >= 0;
+        }
+
+        // Read the stats of the cgroup at path. Controllers that are not
+        // enabled there (and the files the root does not have) leave their
+        // fields 0. Returns false if the cgroup is not there.
+        bool read(const std::string &path, CgroupStats &stats);
+
+    private:
+        // Read <path>/<name> into mBuf and return its length, or -1.
+        long readFile(const std::string &path, const char *name);
+
+        int mRootFd;
+        std::string mPath;
+        char mBuf[1024];
+    };
+
+    // Groups processes by their cgroup v2 path and reads each group's
+    // totals from its controller files. A process's cgroup is read from
+    // /proc once and cached for as long as its pid and start time match.
+    class CgroupTable
+    {
+    public:
+        static constexpr char DEFAULT_ROOT[] = "/sys/fs/cgroup";
+
+        // Reads the cgroupfs at root, and the processes' cgroups from the
+        // procfs at procRoot.
+        CgroupTable(const std::string &root = DEFAULT_ROOT,
+                    const std::string &procRoot = ProcReader::DEFAULT_ROOT);
+
+        ~CgroupTable() = default;
+
+        CgroupTable(const CgroupTable &) = delete;
+        CgroupTable &operator=(const CgroupTable &) = delete;
+
+        // Place processes in their cgroups and re-read the stats of every
+        // cgroup holding one, and of their ancestors.
+        void refresh(const std::map<int, Process> &processes);
+
+        // The cgroups as of the last refresh, sorted by path, so parents
+        // come before their children.
+        inline const std::vector<Cgroup> &getCgroups() const
+        {
+            return mCgroups;
+        }
+
+    private:
+        // A cgroup seen in the last refresh.
+        struct Node
+        {
+            std::vector<int> pids;
+            unsigned long long lastUsage = 0;
+            bool hasUsage = false;
+            bool live = false;
+            // Position in mCgroups.
+            int index = -1;
+        };
+
+        // Cgroup of a process, while it still has this start time.
+        struct Member
+        {
+            unsigned long long startTime = 0;
+            Node *node = nullptr;
+            unsigned generation = 0;
+        };
+
+        ProcReader mReader;
+        CgroupReader mStats;
+        // Keyed by path; node addresses are stable, so members can point at
+        // them.
+        std::map<std::string, Node, std::less<>> mNodes;
+        std::unordered_map<int, Member> mMembers;
+        unsigned mGeneration;
+        std::vector<Cgroup> mCgroups;
+        std::chrono::steady_clock::time_point mLastTime;
+        // Scratch for paths read from /proc, and for sibling indices.
+        std::string mPath;
+        std::vector<int> mChildCounts;
+    };
+}
+
+#endif /* GLTOP_CGROUP_HPP */
@@ -0,0 +1,297 @@
+extern "C" {
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+}
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+#include "collector.hpp"
+
+using namespace std::string_literals;
+namespace chron = std::chrono;
+
+gltop::Collector::Collector(std::chrono::milliseconds interval)
+    : mProcRoot(ProcReader::DEFAULT_ROOT),
+      mPidMax(PidIndex::readPidMax(mProcRoot)),mInterval(interval),
+      mScheduler(interval),mLastBusy(0.f),mTable(),mSystem(),mSystemStats(),
+      mIo(),mIoSampling(false),mMemory(),mMemoryDetail(false),
+      mMemoryCap(DEFAULT_MEMORY_CPU_CAP),mCgroups(),mCgroupMode(false),
+      mCgroupRoot(),mScanBirths(0),mScanDeaths(0),mSequence(0),mEvents(),
+      mUseEvents(false),mHistory(),mHistoryDepth(DEFAULT_HISTORY_DEPTH),
+      mHistoryBytes(DEFAULT_HISTORY_BYTES),mRecordPath(),mRecorder(),
+      mSnapshots(),mThread(),
+      mPaused(false),mRunning(false),mRequestLock(),mExpandRequests(),
+      mMemoryRequests(),mWakeFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+    if(mWakeFd < 0)
+        throw std::runtime_error("Could not create eventfd: "s
+                                 + std::strerror(errno));
+}
+
+gltop::Collector::~Collector()
+{
+    stop();
+    close(mWakeFd);
+}
+
+void gltop::Collector::start()
+{
+    if(mThread.joinable())
+        return;
+
+    // Events describe the real /proc, not a synthetic one.
+    if(mUseEvents && mProcRoot != ProcReader::DEFAULT_ROOT)
+        std::cerr << "Process events ignored with procfs root "
+                  << mProcRoot << ".\n";
+    else if(mUseEvents)
+    {
+        mEvents = std::make_unique<ProcEvents>();
+        if(!mEvents->isOpen())
+        {
+            std::cerr << "Process events unavailable, polling /proc.\n";
+            mEvents.reset();
+        }
+    }
+
+    // No point reading a process's I/O more often than it is scanned.
+    mIo.setInterval(std::max(mInterval, IoAccounting::DEFAULT_INTERVAL));
+
+    if(mCgroupMode && !mCgroups)
+        mCgroups = std::make_unique<CgroupTable>(mCgroupRoot, mProcRoot);
+
+    if(!mHistory)
+        mHistory = std::make_unique<History>(mHistoryDepth, mHistoryBytes);
+
+    if(!mRecordPath.empty() && !mRecorder)
+    {
+        try
+        {
+            mRecorder = std::make_unique<SessionRecorder>(mRecordPath);
+        }
+        catch(std::exception &e)
+        {
+            std::cerr << "Could not record the session: " << e.what()
+                      << '\n';
+        }
+    }
+
+    mRunning = true;
+    mThread = std::thread(&Collector::run, this);
+}
+
+void gltop::Collector::stop()
+{
+    mRunning = false;
+    std::uint64_t one = 1;
+    if(write(mWakeFd, &one, sizeof(one)) < 0)
+        std::cerr << "Could not wake the collector thread.\n";
+    if(mThread.joinable())
+        mThread.join();
+}
+
+void gltop::Collector::setProcRoot(const std::string &root)
+{
+    mProcRoot = root;
+    mPidMax = PidIndex::readPidMax(root);
+    mTable.setRoot(root);
+    mSystem.open(root);
+    mIo.setProcRoot(root);
+    mMemory.setProcRoot(root);
+}
+
+void gltop::Collector::setExpanded(int pid, bool expanded)
+{
+    std::lock_guard<std::mutex> lock(mRequestLock);
+    mExpandRequests.emplace_back(pid, expanded);
+}
+
+void gltop::Collector::setMemoryPriority(int pid, bool priority)
+{
+    std::lock_guard<std::mutex> lock(mRequestLock);
+    mMemoryRequests.emplace_back(pid, priority);
+}
+
+void gltop::Collector::run()
+{
+    using clock = Snapshot::clock;
+    auto nextScan = clock::now();
+    auto lastPublish = nextScan;
+    unsigned scans = 0;
+    // Events were missed (or there are none yet): walk /proc next scan.
+    bool mustWalk = true;
+    // Events have changed the table since the last snapshot.
+    bool dirty = false;
+    // CPU time of publishing snapshots and handling events since the last
+    // scan, which the scheduler counts as part of the scan.
+    chron::nanoseconds overhead(0);
+
+    while(mRunning)
+    {
+        auto now = clock::now();
+        try
+        {
+            if(now >= nextScan)
+            {
+                if(!isPaused())
+                {
+                    bool walk = !mEvents || mustWalk
+                        || scans % RECONCILE_SCANS == 0;
+                    auto scanStart = getThreadTime();
+                    {
+                        std::lock_guard<std::mutex> lock(mRequestLock);
+                        for(auto [pid, expanded] : mExpandRequests)
+                            mTable.setExpanded(pid, expanded);
+                        mExpandRequests.clear();
+                        for(auto [pid, priority] : mMemoryRequests)
+                            mMemory.setPriority(pid, priority);
+                        mMemoryRequests.clear();
+                    }
+                    auto refreshStart = clock::now();
+                    mTable.refresh(walk);
+                    auto refreshTime = clock::now() - refreshStart;
+                    mHistory->append(mTable.getProcesses());
+                    mSystem.sample(mSystemStats);
+                    auto coreEnd = getThreadTime();
+
+                    bool extras = !mScheduler.isShedding();
+                    if(extras && mCgroups)
+                        mCgroups->refresh(mTable.getProcesses());
+                    if(extras && mIoSampling)
+                        mIo.sample(mTable.getProcesses());
+                    auto extrasEnd = getThreadTime();
+
+                    auto busy = mSystemStats.cpuBusy;
+                    auto core = coreEnd - scanStart + overhead;
+                    overhead = chron::nanoseconds::zero();
+                    mScheduler.update(core,
+                                      extrasEnd - coreEnd,
+                                      mTable.getProcesses().size(),
+                                      mScanBirths + mTable.getBirths(),
+                                      mScanDeaths + mTable.getDeaths(),
+                                      std::abs(busy - mLastBusy));
+                    mLastBusy = busy;
+
+                    // PSS gets whatever the scan left of its own cap and of
+                    // the scheduler's budget, so it is not counted above.
+                    // The selected process is read even if that is nothing.
+                    if(extras && mMemoryDetail)
+                    {
+                        float cap = mMemoryCap;
+                        if(mScheduler.getBudget() > 0.f)
+                            cap = std::min(cap, mScheduler.getBudget());
+                        auto budget = chron::duration_cast<chron::nanoseconds>
+                            (mScheduler.getInterval() * (cap / 100.f))
+                            - core - (extrasEnd - coreEnd);
+                        mMemory.sample(mTable.getProcesses(), budget);
+                    }
+                    auto publishStart = getThreadTime();
+                    publish(refreshTime);
+                    overhead += getThreadTime() - publishStart;
+                    mScanBirths = 0;
+                    mScanDeaths = 0;
+                    mustWalk = false;
+                    dirty = false;
+                    lastPublish = clock::now();
+                    scans++;
+                }
+                nextScan = now + mScheduler.getInterval();
+            }
+            else if(dirty && now - lastPublish >= EVENT_PUBLISH_INTERVAL)
+            {
+                auto publishStart = getThreadTime();
+                publish();
+                overhead += getThreadTime() - publishStart;
+                dirty = false;
+                lastPublish = now;
+            }
+        }
+        catch(std::exception &e)
+        {
+            std::cerr << "Could not collect processes: " << e.what()
+                      << '\n';
+            nextScan = now + mScheduler.getInterval();
+        }
+
+        // Sleep until the next scan or snapshot is due, an event arrives,
+        // or stop() is called.
+        auto wake = dirty ? std::min(nextScan,
+                                     lastPublish + EVENT_PUBLISH_INTERVAL)
+            : nextScan;
+        auto timeout = chron::ceil<chron::milliseconds>(wake - clock::now());
+        pollfd fds[2] = {
+            { mWakeFd, POLLIN, 0 },
+            { mEvents ? mEvents->getFd() : -1, POLLIN, 0 },
+        };
+        if(poll(fds, mEvents ? 2 : 1,
+                static_cast<int>(std::max<chron::milliseconds::rep>
+                                 (timeout.count(), 0))) <= 0)
+            continue;
+
+        if(fds[0].revents & POLLIN)
+        {
+            std::uint64_t count;
+            if(read(mWakeFd, &count, sizeof(count)) < 0)
+                continue;
+        }
+
+        if(mEvents && (fds[1].revents & POLLIN))
+        {
+            auto eventsStart = getThreadTime();
+            bool paused = isPaused();
+            bool complete = mEvents->read([&](const ProcEvent &event)
+            {
+                if(!paused)
+                    mTable.applyEvent(event);
+            });
+            if(paused || !complete)
+                mustWalk = true;
+            else
+                dirty = true;
+            overhead += getThreadTime() - eventsStart;
+        }
+    }
+}
+
+void gltop::Collector::publish(Snapshot::clock::duration refreshTime)
+{
+    // Refilling the old store reuses its columns.
+    auto &snapshot = mSnapshots.getBack();
+    auto buildStart = Snapshot::clock::now();
+    snapshot.processes.setPidMax(mPidMax);
+    snapshot.processes.setAdoptOrphans(mTable.isFiltered());
+    snapshot.processes.assign(mTable.getProcesses());
+    snapshot.buildTime = Snapshot::clock::now() - buildStart;
+    snapshot.births = mTable.getBirths();
+    snapshot.deaths = mTable.getDeaths();
+    snapshot.time = Snapshot::clock::now();
+    snapshot.refreshTime = refreshTime;
+    snapshot.sequence = ++mSequence;
+    snapshot.interval = mScheduler.getInterval();
+    snapshot.scanCost = mScheduler.getCost();
+    snapshot.scanUsage = mScheduler.getUsage();
+    snapshot.shedding = mScheduler.isShedding();
+    snapshot.history = mHistory.get();
+    snapshot.system = mSystemStats;
+    if(mCgroups)
+        snapshot.cgroups = mCgroups->getCgroups();
+    if(mRecorder)
+        mRecorder->record(snapshot.processes, snapshot.system,
+                          snapshot.sequence);
+    mSnapshots.publish();
+
+    // Exited processes have now been in a snapshot; dropping them counts
+    // towards the next one.
+    mScanBirths += mTable.getBirths();
+    mScanDeaths += mTable.getDeaths();
+    mTable.clearCounts();
+    mTable.flushExited();
+}
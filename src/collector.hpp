@@ -0,0 +1,280 @@
+#ifndef GLTOP_COLLECTOR_HPP
+#define GLTOP_COLLECTOR_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cgroup.hpp"
+#include "gltop.hpp"
+#include "history.hpp"
+#include "io.hpp"
+#include "memory.hpp"
+#include "recorder.hpp"
+#include "scheduler.hpp"
+#include "store.hpp"
+#include "system.hpp"
+#include "util.hpp"
+
+namespace gltop
+{
+    // Immutable view of the process table at one point in time.
+    struct Snapshot
+    {
+        using clock = std::chrono::steady_clock;
+
+        // The processes, as columns.
+        ProcessStore processes;
+        // Births and deaths since the previous snapshot.
+        std::size_t births = 0;
+        std::size_t deaths = 0;
+        // When the snapshot was taken, and how long the table refresh
+        // before it took; zero if it was published for events rather than
+        // after a scan.
+        clock::time_point time;
+        clock::duration refreshTime = clock::duration::zero();
+        // How long building the tree into processes took.
+        clock::duration buildTime = clock::duration::zero();
+        // Time until the next scan, the smoothed CPU time of a scan (with
+        // the snapshots and events between scans) and its share of one
+        // core (%), and whether the optional reads are
+        // being shed to stay within the CPU budget.
+        std::chrono::milliseconds interval = std::chrono::milliseconds(0);
+        std::chrono::nanoseconds scanCost = std::chrono::nanoseconds(0);
+        float scanUsage = 0.f;
+        bool shedding = false;
+        // Increments with every snapshot; 0 means nothing collected yet.
+        std::uint64_t sequence = 0;
+        // Recent samples of each process, indexed by getHistorySlot(). Owned
+        // by the collector and appended to while being read.
+        const History *history = nullptr;
+        // System wide memory, CPU, load and pressure at the last scan.
+        SystemStats system;
+        // The processes grouped by cgroup, parents first. Empty unless
+        // the collector is in cgroup mode.
+        std::vector<Cgroup> cgroups;
+    };
+
+    // Samples /proc on its own thread and hands snapshots to one reader
+    // thread through a TripleBuffer, so the reader never waits on /proc I/O
+    // or on a lock. Optionally listens to proc connector events, so births
+    // and deaths show up between scans and most scans can skip walking
+    // /proc.
+    class Collector
+    {
+    public:
+        // With events on, every RECONCILE_SCANS'th scan still walks /proc
+        // to catch anything the events missed.
+        static constexpr unsigned RECONCILE_SCANS = 10;
+        // Minimum time between snapshots published because of events.
+        static constexpr std::chrono::milliseconds EVENT_PUBLISH_INTERVAL
+            = std::chrono::milliseconds(100);
+        // Samples of history kept per process, and the memory they may use.
+        static constexpr std::size_t DEFAULT_HISTORY_DEPTH = 60;
+        static constexpr std::size_t DEFAULT_HISTORY_BYTES = 32u << 20;
+        // Share of one CPU (%) the collector thread may use before it
+        // stops reading smaps_rollup for the scan.
+        static constexpr float DEFAULT_MEMORY_CPU_CAP = 2.f;
+
+        Collector(std::chrono::milliseconds interval);
+
+        // Stops the thread.
+        ~Collector();
+
+        Collector(const Collector &) = delete;
+        Collector &operator=(const Collector &) = delete;
+
+        // Start sampling. Does nothing if already started.
+        void start();
+
+        // Stop sampling and join the thread.
+        void stop();
+
+        // Read processes and system figures from the procfs at root (a
+        // directory laid out like /proc). Only call before start().
+        void setProcRoot(const std::string &root);
+
+        // Number of threads each scan is split across. Only call before
+        // start().
+        inline void setScanThreads(unsigned threads)
+        {
+            mTable.setThreads(threads);
+        }
+
+        // Only collect the processes of user userName (a name or a numeric
+        // uid) named procName, as ProcFilter picks them; an empty string
+        // matches all. Init is kept as the map's root, and the rest hang
+        // off it. Throws if the user does not exist. Only call before
+        // start().
+        inline void setFilter(std::string_view userName,
+                              std::string_view procName)
+        {
+            mTable.setFilter(ProcFilter(userName, procName));
+        }
+
+        // Read every process's threads. Only call before start().
+        inline void setThreadMode(bool threadMode)
+        {
+            mTable.setThreadMode(threadMode);
+        }
+
+        // Group processes by cgroup v2, with the groups' totals read from
+        // the cgroupfs mounted at root. Only call before start().
+        inline void setCgroupMode(bool cgroupMode,
+                                  const std::string &root
+                                  = CgroupTable::DEFAULT_ROOT)
+        {
+            mCgroupMode = cgroupMode;
+            mCgroupRoot = root;
+        }
+
+        // Read the threads of pid (or stop), from the next scan on. May be
+        // called from any thread.
+        void setExpanded(int pid, bool expanded);
+
+        // Read PSS and USS, keeping the collector thread's CPU use under
+        // cpuCap (% of one CPU). Only call before start().
+        inline void setMemoryDetail(bool memoryDetail,
+                                    float cpuCap = DEFAULT_MEMORY_CPU_CAP)
+        {
+            mMemoryDetail = memoryDetail;
+            mMemoryCap = cpuCap;
+        }
+
+        // Keep the collector thread's CPU use within budget (% of one
+        // core) by scanning less often, and more often when processes come
+        // and go. 0 always scans at the given interval. Only call before
+        // start().
+        inline void setCpuBudget(float budget)
+        {
+            mScheduler.setBudget(budget);
+        }
+
+        // Sample each process's I/O at most once a second. Only call
+        // before start().
+        inline void setIoSampling(bool ioSampling)
+        {
+            mIoSampling = ioSampling;
+        }
+
+        // Read pid's PSS and USS every scan (or stop), from the next scan
+        // on. May be called from any thread.
+        void setMemoryPriority(int pid, bool priority);
+
+        // Base time between scans; the scheduler moves away from it.
+        inline std::chrono::milliseconds getInterval() const
+        {
+            return mInterval;
+        }
+
+        // Listen to proc connector events. Only call before start(). If
+        // the subscription fails, start() falls back to polling.
+        inline void setUseEvents(bool useEvents)
+        {
+            mUseEvents = useEvents;
+        }
+
+        // Keep depth samples of history per process in at most maxBytes.
+        // Only call before start().
+        inline void setHistory(std::size_t depth, std::size_t maxBytes)
+        {
+            mHistoryDepth = depth;
+            mHistoryBytes = maxBytes;
+        }
+
+        // Append every snapshot to the session log at path. Only call
+        // before start().
+        inline void setRecordPath(const std::string &path)
+        {
+            mRecordPath = path;
+        }
+
+        // Pause or resume sampling without stopping the thread.
+        inline void setPaused(bool paused)
+        {
+            mPaused.store(paused, std::memory_order_relaxed);
+        }
+
+        inline bool isPaused() const
+        {
+            return mPaused.load(std::memory_order_relaxed);
+        }
+
+        // Latest snapshot. Only call from the one reader thread; the result
+        // is valid until its next call.
+        inline const Snapshot &acquire()
+        {
+            mSnapshots.update();
+            return mSnapshots.getFront();
+        }
+
+    private:
+        // Thread body.
+        void run();
+
+        // Publish a snapshot of the table, after a refresh that took
+        // refreshTime (zero if events changed it instead).
+        void publish(Snapshot::clock::duration refreshTime =
+                     Snapshot::clock::duration::zero());
+
+        // procfs root, and its pid_max.
+        std::string mProcRoot;
+        std::size_t mPidMax;
+        // Base time between scans, and what picks the actual one.
+        std::chrono::milliseconds mInterval;
+        ScanScheduler mScheduler;
+        float mLastBusy;
+        // Only touched by the collector thread.
+        ProcessTable mTable;
+        SystemSampler mSystem;
+        SystemStats mSystemStats;
+        // I/O rates, when sampling them.
+        IoAccounting mIo;
+        bool mIoSampling;
+        // PSS and USS, read within what is left of the CPU cap after each
+        // scan.
+        MemoryAccounting mMemory;
+        bool mMemoryDetail;
+        float mMemoryCap;
+        // Refreshed after the table in cgroup mode.
+        std::unique_ptr<CgroupTable> mCgroups;
+        bool mCgroupMode;
+        std::string mCgroupRoot;
+        // Births and deaths published since the last scan, for the
+        // scheduler; event snapshots in between clear the table's counts.
+        std::size_t mScanBirths;
+        std::size_t mScanDeaths;
+        std::uint64_t mSequence;
+        std::unique_ptr<ProcEvents> mEvents;
+        bool mUseEvents;
+        // Appended to after every scan.
+        std::unique_ptr<History> mHistory;
+        std::size_t mHistoryDepth;
+        std::size_t mHistoryBytes;
+        // Session log, when recording.
+        std::string mRecordPath;
+        std::unique_ptr<SessionRecorder> mRecorder;
+        // Snapshot handoff.
+        TripleBuffer<Snapshot> mSnapshots;
+        std::thread mThread;
+        std::atomic<bool> mPaused;
+        std::atomic<bool> mRunning;
+        // setExpanded() and setMemoryPriority() calls waiting for the next
+        // scan.
+        std::mutex mRequestLock;
+        std::vector<std::pair<int, bool>> mExpandRequests;
+        std::vector<std::pair<int, bool>> mMemoryRequests;
+        // eventfd stop() uses to wake the thread.
+        int mWakeFd;
+    };
+}
+
+#endif /* GLTOP_COLLECTOR_HPP */
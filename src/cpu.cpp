@@ -0,0 +1,97 @@
+extern "C" {
+#include <unistd.h>
+#include <time.h>
+}
+
+#include <algorithm>
+
+#include "cpu.hpp"
+#include "gltop.hpp"
+
+namespace
+{
+    // Seconds since boot, on the same clock as the tasks' start times.
+    double getBootTime()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_BOOTTIME, &ts);
+        return static_cast<double>(ts.tv_sec)
+            + static_cast<double>(ts.tv_nsec) / 1e9;
+    }
+}
+
+gltop::CpuAccounting::CpuAccounting()
+    : mTicksPerSec(sysconf(_SC_CLK_TCK)),mLastTime(0.),mTotal(0.f),
+      mTickScale(0.f),mPids(),mStarts(),mTicks(),mPrevTicks(),mSeconds(),
+      mCpu(),mLastPids(),mLastStarts(),mLastTicks()
+{
+    if(mTicksPerSec <= 0)
+        mTicksPerSec = 100;
+}
+
+void gltop::CpuAccounting::sample(std::map<int, Process> &processes)
+{
+    double now = getBootTime();
+    double interval = (mLastTime > 0.) ? now - mLastTime : now;
+    mLastTime = now;
+
+    std::size_t n = processes.size();
+    mPids.resize(n);
+    mStarts.resize(n);
+    mTicks.resize(n);
+    mPrevTicks.resize(n);
+    mSeconds.resize(n);
+    mCpu.resize(n);
+
+    std::size_t i = 0;
+    for(auto &[pid, proc] : processes)
+    {
+        mPids[i] = pid;
+        mStarts[i] = proc.mProc.startTime;
+        mTicks[i] = proc.mProc.utime + proc.mProc.stime;
+        i++;
+    }
+
+    // Line the previous sample up with this one. Both are in pid order.
+    // Processes we have not seen before are measured from their start.
+    auto tps = static_cast<double>(mTicksPerSec);
+    std::size_t j = 0;
+    for(i = 0; i < n; i++)
+    {
+        while(j < mLastPids.size() && mLastPids[j] < mPids[i])
+            j++;
+        if(j < mLastPids.size() && mLastPids[j] == mPids[i]
+           && mLastStarts[j] == mStarts[i] && mLastTicks[j] <= mTicks[i])
+        {
+            mPrevTicks[i] = mLastTicks[j];
+            mSeconds[i] = static_cast<float>(interval);
+        }
+        else
+        {
+            mPrevTicks[i] = 0;
+            double age = now - static_cast<double>(mStarts[i]) / tps;
+            mSeconds[i] = static_cast<float>(std::clamp(age, 1e-3, interval));
+        }
+    }
+
+    // The per task pass.
+    long cpus = std::max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+    float scale = 100.f / static_cast<float>(tps * static_cast<double>(cpus));
+    mTickScale = scale / static_cast<float>(interval);
+    float total = 0.f;
+    for(i = 0; i < n; i++)
+    {
+        mCpu[i] = static_cast<float>(mTicks[i] - mPrevTicks[i]) * scale
+            / mSeconds[i];
+        total += mCpu[i];
+    }
+    mTotal = total;
+
+    i = 0;
+    for(auto &[pid, proc] : processes)
+        proc.mCpu = mCpu[i++];
+
+    mLastPids.swap(mPids);
+    mLastStarts.swap(mStarts);
+    mLastTicks.swap(mTicks);
+}
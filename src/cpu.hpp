@@ -0,0 +1,63 @@
+#ifndef GLTOP_CPU_HPP
+#define GLTOP_CPU_HPP
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace gltop
+{
+    class Process;
+
+    // Works out each process's CPU use over the interval between two
+    // samples from its utime + stime, as a percentage of all online CPUs.
+    // The work is done on columns in pid order so the per task maths is
+    // one flat pass. Subtree totals are left to ProcessStore.
+    class CpuAccounting
+    {
+    public:
+        CpuAccounting();
+
+        ~CpuAccounting() = default;
+
+        // Sample processes and store each one's CPU use since the previous
+        // sample in it.
+        void sample(std::map<int, Process> &processes);
+
+        // Sum of the CPU use of every process in the last sample.
+        inline float getTotal() const
+        {
+            return mTotal;
+        }
+
+        // CPU use (%) of a task that ran for the given number of ticks over
+        // the last sample's whole interval.
+        inline float ticksToCpu(unsigned long long ticks) const
+        {
+            return static_cast<float>(ticks) * mTickScale;
+        }
+
+    private:
+        long mTicksPerSec;
+        // Seconds since boot at the previous sample (0 before the first).
+        double mLastTime;
+        float mTotal;
+        // ticksToCpu() factor for the last interval.
+        float mTickScale;
+        // This sample's columns, one entry per process in pid order.
+        std::vector<int> mPids;
+        std::vector<unsigned long long> mStarts;
+        std::vector<unsigned long long> mTicks;
+        // Ticks at the previous sample and the seconds since then (less
+        // for processes started in between).
+        std::vector<unsigned long long> mPrevTicks;
+        std::vector<float> mSeconds;
+        std::vector<float> mCpu;
+        // The previous sample's pid, start time and ticks columns.
+        std::vector<int> mLastPids;
+        std::vector<unsigned long long> mLastStarts;
+        std::vector<unsigned long long> mLastTicks;
+    };
+}
+
+#endif /* GLTOP_CPU_HPP */
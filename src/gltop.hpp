@@ -4,31 +4,85 @@
 extern "C" {
 #include <unistd.h>
 #include <sys/types.h>
-#include <sys/types.h>
-#include <proc/procps.h>
-#include <proc/readproc.h>
 }
 
+#include <iostream>
+#include <map>
+#include <set>
 #include <memory>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <chrono>
 #include <functional>
 
+#include "cpu.hpp"
+#include "names.hpp"
+#include "procevents.hpp"
+#include "procfs.hpp"
+#include "util.hpp"
+
 namespace gltop
 {
+    // Field tiers (ProcFields masks). The hot tier is read for every task
+    // on every refresh; the warm and cold tiers are read the first time an
+    // accessor needs them.
+    enum ProcTier : unsigned
+    {
+        TIER_HOT  = PROC_FIELD_STAT,    // ppid, comm, times, vsize, rss...
+        TIER_WARM = PROC_FIELD_STATUS,  // tgid, uid, gid, user/group names.
+        TIER_COLD = PROC_FIELD_CMDLINE, // argv.
+    };
+
+    // One thread of a process. Kept small, since a busy host can have a
+    // hundred thousand of them.
+    struct ThreadInfo
+    {
+        int tid = 0;                  // Thread id.
+        int processor = 0;            // Last CPU the thread ran on.
+        unsigned long long ticks = 0; // utime + stime (clock ticks).
+        float cpu = 0.f;              // CPU use over the last interval (%).
+        char state = '\0';            // R, S, D, Z...
+        char cmd[16] = {};            // Thread name, NUL terminated.
+    };
+
+    // I/O of a process per second, over the time between its last two
+    // reads of /proc/<pid>/io.
+    struct IoRates
+    {
+        float readBytes = 0.f;
+        float writeBytes = 0.f;
+        float syscr = 0.f;
+        float syscw = 0.f;
+    };
+
     class Process
     {
     public:
         // Construct a new process (NULL).
-        Process() : mProc(nullptr, &freeproc),mChildren()
+        Process() : mProc(),mCmdline(),mNull(true),mReader(),mLoaded(0),
+                    mCpu(0.f),mHistorySlot(-1),mThreads(),
+                    mUserId(NameCache::NONE),mGroupId(NameCache::NONE),
+                    mNameGeneration(0),mMemory(),mMemoryAge(-1),
+                    mMemoryTime(),mMemoryRss(0),mMemoryRetry(),
+                    mIo(),mIoRates(),mIoTime(0.),mIoRetry(0.)
         {
         }
 
-        // Construct a new process.
-        Process(PROCTAB *proctab) : mProc(readproc(proctab, nullptr),
-                                          &freeproc)
+        // Construct a new process from a task read by reader. loaded is the
+        // ProcFields that were read into info; the rest are read from
+        // reader on demand.
+        Process(const ProcInfo &info, std::shared_ptr<ProcReader> reader,
+                unsigned loaded)
+            : mProc(info),mCmdline(),mNull(false),mReader(std::move(reader)),
+              mLoaded(loaded),mCpu(0.f),mHistorySlot(-1),mThreads(),
+              mUserId(NameCache::NONE),mGroupId(NameCache::NONE),
+              mNameGeneration(0),mMemory(),mMemoryAge(-1),mMemoryTime(),
+              mMemoryRss(0),mMemoryRetry(),mIo(),mIoRates(),mIoTime(0.),
+              mIoRetry(0.)
         {
+            if(mLoaded & PROC_FIELD_CMDLINE)
+                mCmdline = StringPool::get().intern(mReader->getCmdline());
         }
 
         // Destroy process.
@@ -37,83 +91,158 @@ namespace gltop
         // Get task id (this is the PID for the main task).
         inline int getTID() const
         {
-            return mProc->tid;
+            return mProc.tid;
         }
 
         // Get Parent's PID.
         inline int getPPID() const
         {
-            return mProc->ppid;
+            return mProc.ppid;
         }
 
-        // Get the start time (Unix time stamp).
+        // Get the start time (clock ticks since boot).
         inline unsigned long long getStartTime() const
         {
-            return mProc->start_time;
+            return mProc.startTime;
         }
 
         // Get the nice.
         inline long getNice() const
         {
-            return mProc->nice;
+            return mProc.nice;
         }
 
         // Get virtual memory usage.
         inline unsigned long getVMem() const
         {
-            return (mProc) ? mProc->vm_size : -1;
+            return (!mNull) ? mProc.vmSize : -1;
+        }
+
+        // Get the NUL separated command line (cold tier). Views the
+        // pooled copy, which lives as long as this process.
+        inline std::string_view getCmdline() const
+        {
+            load(TIER_COLD);
+            return mCmdline ? std::string_view(*mCmdline)
+                : std::string_view();
+        }
+
+        // Get resident set size (kB).
+        inline unsigned long getRSS() const
+        {
+            return mProc.vmRSS;
         }
 
-        // Get the argument vector used to start the process.
-        inline std::vector<std::string> getArgv() const
+        // Get the argument vector used to start the process (cold tier).
+        inline std::vector<std::string_view> getArgv() const
         {
-            if(!mProc)
+            if(mNull)
             {
                 std::cerr << "Not nproc\n";
-                return std::vector<std::string>();
+                return std::vector<std::string_view>();
             }
-            // Get the size of the argument vector.
-            std::size_t argc = 0;
-            auto argv = mProc->cmdline;
-            if(argv)
+            std::vector<std::string_view> argv;
+            std::string_view cmdline = getCmdline();
+            while(!cmdline.empty())
             {
-                for(char *tmp = argv[0]; tmp; tmp = *(++argv), argc++);
-
-                return std::vector<std::string>(mProc->cmdline,
-                                                mProc->cmdline + argc);
+                auto end = cmdline.find('\0');
+                argv.push_back(cmdline.substr(0, end));
+                if(end == std::string_view::npos)
+                    break;
+                cmdline.remove_prefix(end + 1);
             }
-            return std::vector<std::string>();
+            return argv;
         }
 
-        // Get the basename of the process.
-        inline std::string getBasename() const
+        // Get the basename of the process. The view is NUL terminated and
+        // lives as long as this process.
+        inline std::string_view getBasename() const
         {
-            if(!mProc)
+            if(mNull)
             {
                 std::cout << "Not nproc\n";
                 return "";
             }
-            if(mProc->cmd)
-                return std::string(mProc->cmd);
-            return "";
+            return mProc.cmd;
+        }
+
+        // Get the thread group ID (warm tier).
+        inline int getTGID() const
+        {
+            load(TIER_WARM);
+            return mProc.tgid;
+        }
+
+        // Get the effective user ID (warm tier).
+        inline uid_t getUID() const
+        {
+            load(TIER_WARM);
+            return mProc.uid;
+        }
+
+        // Get the effective group ID (warm tier).
+        inline gid_t getGID() const
+        {
+            load(TIER_WARM);
+            return mProc.gid;
+        }
+
+        // Get the NameCache id of the effective user's name (warm tier).
+        inline NameCache::Id getUserId() const
+        {
+            resolveNames();
+            return mUserId;
+        }
+
+        // Get the NameCache id of the effective group's name (warm tier).
+        inline NameCache::Id getGroupId() const
+        {
+            resolveNames();
+            return mGroupId;
+        }
+
+        // Get the name of the effective user (warm tier).
+        inline const std::string &getUserName() const
+        {
+            return NameCache::get().getName(getUserId());
+        }
+
+        // Get the name of the effective group (warm tier).
+        inline const std::string &getGroupName() const
+        {
+            return NameCache::get().getName(getGroupId());
         }
 
         // Get process group ID.
         inline int getProcGID() const
         {
-            return mProc->pgrp;
+            return mProc.pgrp;
+        }
+
+        // Get the number of threads (hot tier; no need to list them).
+        inline long getNumThreads() const
+        {
+            return mProc.numThreads;
+        }
+
+        // The threads, leader included, in tid order. Only filled in by a
+        // ProcessTable in thread mode or with this process expanded, and
+        // empty for single threaded processes.
+        inline const std::vector<ThreadInfo> &getThreads() const
+        {
+            return mThreads;
         }
 
         // Get most recent processor this task was run on.
         inline int getProcessor() const
         {
-            return mProc->processor;
+            return mProc.processor;
         }
 
         // True if the underlying proc is NULL.
         inline bool isNull() const
         {
-            return mProc == nullptr;
+            return mNull;
         }
 
         inline operator bool() const
@@ -123,65 +252,434 @@ namespace gltop
 
         inline bool isChildOf(int pid)
         {
-            return mProc->ppid == pid;
+            return mProc.ppid == pid;
         }
 
-        inline void addChild(int cpid)
+        // Stop reading lazy tiers through the reader, so this copy can be
+        // handed to another thread. Unloaded tiers stay empty.
+        inline void detach()
         {
-            mChildren.push_back(cpid);
+            mReader.reset();
         }
 
-        inline std::vector<int> getChildrenPids() const
+        // Lifetime average %CPU, like ps. See getCPU() for current use.
+        inline int getCPUTicks() const
         {
-            return mChildren;
+            return (!mNull) ? mProc.pcpu : 0;
         }
 
-        inline int getCPUTicks() const
+        // CPU use over the last sampling interval, as a percentage of all
+        // online CPUs.
+        inline float getCPU() const
+        {
+            return mCpu;
+        }
+
+        // Slot of this process in the History, or -1 if it has none.
+        inline int getHistorySlot() const
+        {
+            return mHistorySlot;
+        }
+
+        // Proportional and unique set sizes (kB) as of the last
+        // smaps_rollup read, which was getMemoryAge() refreshes ago.
+        inline unsigned long getPSS() const
+        {
+            return mMemory.pss;
+        }
+
+        inline unsigned long getUSS() const
+        {
+            return mMemory.uss;
+        }
+
+        // Refreshes since PSS and USS were read, or -1 if they never were.
+        inline int getMemoryAge() const
+        {
+            return mMemoryAge;
+        }
+
+        // When PSS and USS were read (the clock's epoch if never).
+        inline std::chrono::steady_clock::time_point getMemoryTime() const
+        {
+            return mMemoryTime;
+        }
+
+        // I/O per second, all 0 until the counters have been read twice.
+        inline const IoRates &getIoRates() const
+        {
+            return mIoRates;
+        }
+    private:
+        // Refreshes mProc in place.
+        friend class ProcessTable;
+        // Fills in mCpu.
+        friend class CpuAccounting;
+        // Hands out mHistorySlot.
+        friend class History;
+        // Fills in mMemory.
+        friend class MemoryAccounting;
+        // Fills in mIo and mIoRates.
+        friend class IoAccounting;
+
+        // Read the tiers in fields that have not been read yet. Returns
+        // false if the task has gone away.
+        bool load(unsigned fields) const;
+
+        // Look up the user and group name ids, unless they are current.
+        void resolveNames() const;
+
+        // The process. Mutable so the const accessors can fill in the lazy
+        // tiers.
+        mutable ProcInfo mProc;
+        // NUL separated command line, pooled.
+        mutable StringPool::Handle mCmdline;
+        // True if this does not refer to a process.
+        bool mNull;
+        // Reader for the lazy tiers.
+        std::shared_ptr<ProcReader> mReader;
+        // ProcFields that have been read into mProc.
+        mutable unsigned mLoaded;
+        // CPU use over the last interval.
+        float mCpu;
+        // Slot in the History.
+        int mHistorySlot;
+        std::vector<ThreadInfo> mThreads;
+        // User and group name ids, and the NameCache generation they are
+        // from.
+        mutable NameCache::Id mUserId;
+        mutable NameCache::Id mGroupId;
+        mutable std::uint32_t mNameGeneration;
+        // PSS and USS, how stale they are (in refreshes, and when they
+        // were read), the RSS when they were read, and when to try again
+        // if smaps_rollup was not ours to read.
+        MemoryDetail mMemory;
+        int mMemoryAge;
+        std::chrono::steady_clock::time_point mMemoryTime;
+        unsigned long mMemoryRss;
+        std::chrono::steady_clock::time_point mMemoryRetry;
+        // I/O counters at the last read and the rates since the one
+        // before, when they were read and when to try again if they could
+        // not be (seconds on the steady clock; 0 for never).
+        IoCounters mIo;
+        IoRates mIoRates;
+        double mIoTime;
+        double mIoRetry;
+    };
+
+    // Picks processes by owner and by name. Each check costs at most one
+    // small read, and is meant to be done before stat is read.
+    class ProcFilter
+    {
+    public:
+        // Matches every process.
+        ProcFilter()
+            : mUserName(),mUid(0),mProcName()
+        {
+        }
+
+        // Only match the processes of user userName (a name or a numeric
+        // uid) whose basename is procName; an empty string matches all.
+        // Throws if the user does not exist or cannot be looked up.
+        ProcFilter(std::string_view userName, std::string_view procName);
+
+        ~ProcFilter() = default;
+
+        // True if the filter lets everything through.
+        inline bool isEmpty() const
         {
-            return (mProc) ? mProc->pcpu : 0;
+            return mUserName.empty() && mProcName.empty();
         }
+
+        // True if pid passes, read through reader.
+        bool matches(ProcReader &reader, int pid) const;
+
+        // As above, for pid whose /proc directory is owned by owner (only
+        // looked at when filtering by user). Sets kernel if pid turned out
+        // to be a kernel thread, which never changes owner or name.
+        bool matches(ProcReader &reader, int pid, uid_t owner,
+                     bool &kernel) const;
+
     private:
-        // The process.
-        std::shared_ptr<proc_t> mProc;
-        std::vector<int> mChildren;
+        // User name to search for, and its uid.
+        std::string mUserName;
+        uid_t mUid;
+        // Process name to search for, cut to the length of a comm.
+        std::string mProcName;
     };
 
     class Proctab
     {
     public:
-        static constexpr inline unsigned PROCOPEN_ARGS = PROC_FILLMEM | PROC_FILLUSR |
-            PROC_FILLGRP | PROC_FILLARG | PROC_FILLSTATUS | PROC_FILLSTAT;
+        // Only the hot tier is read up front.
+        static constexpr inline unsigned PROCOPEN_ARGS = TIER_HOT;
         Proctab()
-            : mUserName(),mProcName(),mProcsOnly(false),
-              mTab(openproc(PROCOPEN_ARGS),
-                   &closeproc)
-
+            : Proctab(std::make_shared<ProcReader>())
         {
         }
 
-        Proctab(std::string_view userName, std::string_view procName,
-                bool procsOnly = false)
-            : mUserName(userName),mProcName(procName),mProcsOnly(procsOnly),
-              mTab(openproc(PROCOPEN_ARGS),
-                   &closeproc)
+        // Scan with an existing reader, reusing its buffers. Unless
+        // procsOnly, each process is followed by its other threads.
+        Proctab(std::shared_ptr<ProcReader> reader, bool procsOnly = true)
+            : mFilter(),mProcsOnly(procsOnly),mReader(std::move(reader)),
+              mNext(0),mTasks(),mNextTask(0),mTgid(0),mInfo()
         {
+            mReader->scanPids();
         }
 
+        // Scan with reader as above, but only return the processes of user
+        // userName (a name or a numeric uid) whose basename is procName,
+        // as ProcFilter picks them. Threads of a matching process are
+        // returned whatever their names. Throws if the user does not
+        // exist.
+        Proctab(std::shared_ptr<ProcReader> reader,
+                std::string_view userName, std::string_view procName,
+                bool procsOnly = true);
+
         ~Proctab() = default;
 
         Process getNextProcess();
 
     private:
-        // User name to search for.
-        std::string mUserName;
-        // Process name to search for.
-        std::string mProcName;
+        ProcFilter mFilter;
         // Check for processes only (not threads).
         bool mProcsOnly;
-        // The PROCTAB object.
-        std::shared_ptr<PROCTAB> mTab;
+        // Reads the tasks out of /proc.
+        std::shared_ptr<ProcReader> mReader;
+        // Index of the next pid to read in mReader->getPids().
+        std::size_t mNext;
+        // Threads of the last process still to return, and their process.
+        std::vector<int> mTasks;
+        std::size_t mNextTask;
+        int mTgid;
+        // Scratch record the reader parses into.
+        ProcInfo mInfo;
     };
 
+    // Process table kept up to date between refreshes. A task is identified
+    // by (pid, start time): a known task only has its hot tier re-read, a
+    // new one (or a reused pid) starts from scratch, and tasks that have gone
+    // away are dropped. The warm tier is dropped every STATUS_REFRESHES
+    // refreshes, so a setuid() without an exec shows up. A filter's verdict
+    // on each pid is kept between refreshes too, and only looked at again
+    // when the pid gets a new process, on an exec event, or (but for
+    // kernel threads) every STATUS_REFRESHES refreshes. The reads can be
+    // split across several threads. Between refreshes, proc connector
+    // events can keep births and deaths current. Threads are only listed
+    // for the processes that ask for them.
+    class ProcessTable
+    {
+    public:
+        // Fields read for every task on every refresh.
+        static constexpr inline unsigned REFRESH_ARGS = TIER_HOT;
+        // Refreshes a task's warm tier is kept for; tasks take turns by
+        // pid, so only a share of them is re-read each refresh.
+        static constexpr inline unsigned STATUS_REFRESHES = 30;
+
+        ProcessTable()
+            : ProcessTable(std::make_shared<ProcReader>())
+        {
+        }
+
+        ProcessTable(std::shared_ptr<ProcReader> reader, unsigned threads = 1)
+            : mReader(std::move(reader)),mProcesses(),mBirths(0),mDeaths(0),
+              mPool(),mWorkerReaders(),mPids(),mMatched(),mStates(),mFresh(),
+              mVerdicts(),mNextVerdicts(),
+              mExited(),mCpuAccounting(),mFilter(),mThreadMode(false),
+              mExpanded(),mThreaded(),mThreadScratch(),mRefreshes(0)
+        {
+            setThreads(threads);
+        }
+
+        ~ProcessTable() = default;
+
+        // Bring the table up to date and work out CPU use since the last
+        // refresh. If walk is true the pids come from listing /proc, which
+        // also finds births;
+        // otherwise only the known tasks are re-read (for when events are
+        // reporting births).
+        void refresh(bool walk = true);
+
+        // Apply a proc connector event. Threads are ignored. Exits are held
+        // back until flushExited(), so a short lived process still makes
+        // it into a snapshot.
+        void applyEvent(const ProcEvent &event);
+
+        // Drop the processes whose exits applyEvent() held back.
+        void flushExited();
+
+        // Reset the birth and death counts.
+        inline void clearCounts()
+        {
+            mBirths = 0;
+            mDeaths = 0;
+        }
+
+        // Read from another procfs root. Only call while the table is
+        // empty.
+        inline void setRoot(const std::string &root)
+        {
+            mReader = std::make_shared<ProcReader>(root);
+            setThreads(getThreads());
+        }
+
+        // Number of threads (including the caller's) refresh() splits the
+        // /proc reads across. Must not be called during a refresh().
+        void setThreads(unsigned threads);
+
+        inline unsigned getThreads() const
+        {
+            return mPool->getSize();
+        }
+
+        // Only keep the processes filter matches, and init, which the map
+        // hangs everything off. Must not be called during a refresh().
+        inline void setFilter(ProcFilter filter)
+        {
+            mFilter = std::move(filter);
+            mVerdicts.clear();
+        }
+
+        inline bool isFiltered() const
+        {
+            return !mFilter.isEmpty();
+        }
+
+        // Read the threads of every process on each refresh().
+        inline void setThreadMode(bool threadMode)
+        {
+            mThreadMode = threadMode;
+        }
+
+        inline bool getThreadMode() const
+        {
+            return mThreadMode;
+        }
+
+        // Read the threads of pid on each refresh(), even out of thread
+        // mode.
+        inline void setExpanded(int pid, bool expanded)
+        {
+            if(expanded)
+                mExpanded.insert(pid);
+            else
+                mExpanded.erase(pid);
+        }
+
+        // The processes, keyed by pid.
+        inline std::map<int, Process> &getProcesses()
+        {
+            return mProcesses;
+        }
+
+        inline const std::map<int, Process> &getProcesses() const
+        {
+            return mProcesses;
+        }
+
+        // Number of tasks that appeared since the last clearCounts().
+        inline std::size_t getBirths() const
+        {
+            return mBirths;
+        }
+
+        // Number of tasks that went away since the last clearCounts().
+        inline std::size_t getDeaths() const
+        {
+            return mDeaths;
+        }
+
+    private:
+        // What reading a task's hot tier found.
+        enum ScanState : unsigned char
+        {
+            SCAN_GONE, // Exited before it could be read.
+            SCAN_KEPT, // Known task, refreshed in place.
+            SCAN_NEW,  // New task (or reused pid), parsed into fresh.
+        };
+
+        // The filter's last verdict on a pid, and the inode of its /proc
+        // directory at the time (0 if it could not be looked at), which
+        // tells a new process under the same pid apart without a read.
+        struct Verdict
+        {
+            int pid = 0;
+            ino_t ino = 0;
+            bool match = false;
+            bool kernel = false;
+        };
+
+        // True if pid is to be kept, read through reader.
+        inline bool matches(ProcReader &reader, int pid) const
+        {
+            return pid == 1 || mFilter.isEmpty()
+                || mFilter.matches(reader, pid);
+        }
+
+        // As above, reusing verdict (the one from the last refresh, if its
+        // pid is pid) unless force, and leaving the new one in it.
+        bool matches(ProcReader &reader, int pid, Verdict &verdict,
+                     bool force) const;
+
+        // Look at pid again with the filter, updating its verdict.
+        bool recheck(int pid);
+
+        // Read the hot tier of pid, into proc if it is the task we already
+        // know about, otherwise onto the end of fresh. If dropStatus, a
+        // known task's warm tier is read again when next asked for.
+        static ScanState scanTask(ProcReader &reader, int pid, Process *proc,
+                                  std::vector<ProcInfo> &fresh,
+                                  bool dropStatus);
+
+        // Add pid, forked by ppid.
+        void addTask(int pid, int ppid);
+
+        // Re-read the threads of the processes in thread mode or expanded.
+        void refreshThreads();
+
+        // List and read proc's threads, working out their CPU use from the
+        // previous read. scratch is swapped with the old list.
+        void readThreads(ProcReader &reader, Process &proc,
+                         std::vector<ThreadInfo> &scratch) const;
+
+        // Reads the tasks out of /proc. Also used by worker 0.
+        std::shared_ptr<ProcReader> mReader;
+        // Live processes keyed by pid.
+        std::map<int, Process> mProcesses;
+        // Births and deaths since the last clearCounts().
+        std::size_t mBirths;
+        std::size_t mDeaths;
+        // Threads for the reads, and a reader for each besides the caller.
+        std::unique_ptr<WorkerPool> mPool;
+        std::vector<std::unique_ptr<ProcReader>> mWorkerReaders;
+        // Pids to read when not walking /proc.
+        std::vector<int> mPids;
+        // Per pid in the scan: the known process, if any, and what the
+        // read found.
+        std::vector<Process *> mMatched;
+        std::vector<ScanState> mStates;
+        // New tasks found by each worker, in pid order.
+        std::vector<std::vector<ProcInfo>> mFresh;
+        // Filter verdicts from the last walk of /proc, in pid order, and
+        // the ones being made for this refresh (one per pid in the scan).
+        std::vector<Verdict> mVerdicts;
+        std::vector<Verdict> mNextVerdicts;
+        // Exited processes waiting for flushExited(), with their start
+        // times so a reused pid is not dropped by mistake.
+        std::vector<std::pair<int, unsigned long long>> mExited;
+        // Interval CPU use.
+        CpuAccounting mCpuAccounting;
+        // Which processes to keep.
+        ProcFilter mFilter;
+        // Which processes to read the threads of, the processes picked for
+        // this refresh, and a thread list to swap in per worker.
+        bool mThreadMode;
+        std::set<int> mExpanded;
+        std::vector<Process *> mThreaded;
+        std::vector<std::vector<ThreadInfo>> mThreadScratch;
+        // Refreshes so far, to pick whose warm tier to drop.
+        unsigned mRefreshes;
+    };
 }
 
 #endif /* GLTOP_HPP */
@@ -0,0 +1,100 @@
+#include <algorithm>
+
+#include "history.hpp"
+#include "gltop.hpp"
+
+gltop::History::History(std::size_t depth, std::size_t maxBytes)
+    : mDepth(std::max<std::size_t>(depth, 2)),
+      mSlots(std::max<std::size_t>(maxBytes / (mDepth * SAMPLE_BYTES), 1)),
+      mCpu(new std::atomic<float>[mDepth * mSlots]),
+      mRss(new std::atomic<std::uint32_t>[mDepth * mSlots]),
+      mVsz(new std::atomic<std::uint32_t>[mDepth * mSlots]),
+      mFirst(new std::atomic<std::uint64_t>[mSlots]),
+      mSeen(mSlots, 0),mFree(),mUsed(0),mSamples(0),mDropped(0)
+{
+    mFree.reserve(mSlots);
+    for(std::size_t i = 0; i < mSlots; i++)
+        mFirst[i].store(0, std::memory_order_relaxed);
+}
+
+void gltop::History::append(std::map<int, Process> &processes)
+{
+    constexpr auto relaxed = std::memory_order_relaxed;
+    std::uint64_t sample = mSamples.load(relaxed);
+    // 1-based so that 0 can mean free.
+    std::uint64_t seen = sample + 1;
+    std::size_t row = sample % mDepth;
+    mDropped = 0;
+
+    for(auto &[pid, proc] : processes)
+    {
+        int slot = proc.mHistorySlot;
+        if(slot < 0)
+        {
+            if(!mFree.empty())
+            {
+                slot = mFree.back();
+                mFree.pop_back();
+            }
+            else if(mUsed < mSlots)
+                slot = static_cast<int>(mUsed++);
+            else
+            {
+                mDropped++;
+                continue;
+            }
+            proc.mHistorySlot = slot;
+            mFirst[slot].store(sample, relaxed);
+        }
+        mSeen[slot] = seen;
+
+        std::size_t i = at(row, static_cast<std::size_t>(slot));
+        mCpu[i].store(proc.getCPU(), relaxed);
+        mRss[i].store(static_cast<std::uint32_t>(proc.mProc.vmRSS), relaxed);
+        mVsz[i].store(static_cast<std::uint32_t>(proc.mProc.vmSize), relaxed);
+    }
+
+    // Free the slots of processes that have gone.
+    for(std::size_t slot = 0; slot < mUsed; slot++)
+        if(mSeen[slot] && mSeen[slot] != seen)
+        {
+            mSeen[slot] = 0;
+            mFree.push_back(static_cast<int>(slot));
+        }
+
+    mSamples.store(sample + 1, std::memory_order_release);
+}
+
+std::size_t gltop::History::read(int slot, Metric metric, float *out,
+                                 std::size_t max) const
+{
+    constexpr auto relaxed = std::memory_order_relaxed;
+    if(slot < 0 || static_cast<std::size_t>(slot) >= mSlots)
+        return 0;
+
+    std::uint64_t samples = mSamples.load(std::memory_order_acquire);
+    std::uint64_t first = mFirst[slot].load(relaxed);
+    if(samples <= first)
+        return 0;
+    std::size_t count = static_cast<std::size_t>
+        (std::min<std::uint64_t>({ samples - first, mDepth - 1, max }));
+
+    for(std::size_t k = 0; k < count; k++)
+    {
+        std::size_t row = (samples - count + k) % mDepth;
+        std::size_t i = at(row, static_cast<std::size_t>(slot));
+        switch(metric)
+        {
+        case CPU:
+            out[k] = mCpu[i].load(relaxed);
+            break;
+        case RSS:
+            out[k] = static_cast<float>(mRss[i].load(relaxed));
+            break;
+        case VSZ:
+            out[k] = static_cast<float>(mVsz[i].load(relaxed));
+            break;
+        }
+    }
+    return count;
+}
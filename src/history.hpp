@@ -0,0 +1,106 @@
+#ifndef GLTOP_HISTORY_HPP
+#define GLTOP_HISTORY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace gltop
+{
+    class Process;
+
+    // The last few samples of CPU, RSS and VSZ for every live process, in
+    // fixed memory. Each metric is one column laid out as a ring of rows,
+    // one row per sample and one entry per slot, so an append writes one
+    // row. A process keeps its slot for as long as it lives, and slots are
+    // reused once it exits. When all slots are taken, new processes go
+    // without history.
+    //
+    // One thread appends; any number may read at the same time. Readers
+    // see the newest getDepth() - 1 samples, since the oldest row is the
+    // one being overwritten.
+    class History
+    {
+    public:
+        // Metrics kept per sample.
+        enum Metric
+        {
+            CPU, // Interval CPU use (%).
+            RSS, // Resident set size (kB).
+            VSZ, // Virtual memory size (kB).
+        };
+
+        // Bytes per slot per sample, over all metrics.
+        static constexpr std::size_t SAMPLE_BYTES = sizeof(float)
+            + 2 * sizeof(std::uint32_t);
+
+        // Keep depth samples for as many slots as fit in maxBytes.
+        History(std::size_t depth, std::size_t maxBytes);
+
+        ~History() = default;
+
+        History(const History &) = delete;
+        History &operator=(const History &) = delete;
+
+        // Append a sample for every process. Processes without a slot get
+        // one; slots of processes that are not in processes any more are
+        // freed. Does not allocate.
+        void append(std::map<int, Process> &processes);
+
+        // Copy the newest (at most max) samples of metric for slot into
+        // out, oldest first. Returns how many were copied.
+        std::size_t read(int slot, Metric metric, float *out,
+                         std::size_t max) const;
+
+        inline std::size_t getDepth() const
+        {
+            return mDepth;
+        }
+
+        inline std::size_t getSlots() const
+        {
+            return mSlots;
+        }
+
+        // Bytes used by the columns.
+        inline std::size_t getMemory() const
+        {
+            return mDepth * mSlots * SAMPLE_BYTES;
+        }
+
+        // Processes that found no free slot on the last append.
+        inline std::size_t getDropped() const
+        {
+            return mDropped;
+        }
+
+    private:
+        // Index of slot in row.
+        inline std::size_t at(std::size_t row, std::size_t slot) const
+        {
+            return row * mSlots + slot;
+        }
+
+        std::size_t mDepth;
+        std::size_t mSlots;
+        // Metric columns.
+        std::unique_ptr<std::atomic<float>[]> mCpu;
+        std::unique_ptr<std::atomic<std::uint32_t>[]> mRss;
+        std::unique_ptr<std::atomic<std::uint32_t>[]> mVsz;
+        // Per slot: the sample its owner was first appended at, and the
+        // last append that saw it (0 if free).
+        std::unique_ptr<std::atomic<std::uint64_t>[]> mFirst;
+        std::vector<std::uint64_t> mSeen;
+        // Free slots (a stack), and the number of slots ever handed out.
+        std::vector<int> mFree;
+        std::size_t mUsed;
+        // Samples appended so far.
+        std::atomic<std::uint64_t> mSamples;
+        std::size_t mDropped;
+    };
+}
+
+#endif /* GLTOP_HISTORY_HPP */
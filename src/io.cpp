@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <cerrno>
+
+#include "gltop.hpp"
+#include "io.hpp"
+
+namespace
+{
+    // Seconds on the steady clock (never 0).
+    double getTime()
+    {
+        return std::chrono::duration<double>
+            (std::chrono::steady_clock::now().time_since_epoch()).count()
+            + 1.;
+    }
+
+    // Per second rate of a counter that went from before to after.
+    inline float getRate(unsigned long long before, unsigned long long after,
+                         double seconds)
+    {
+        return (after >= before)
+            ? static_cast<float>(static_cast<double>(after - before)
+                                 / seconds)
+            : 0.f;
+    }
+}
+
+gltop::IoAccounting::IoAccounting()
+    : mReader(),mInterval(DEFAULT_INTERVAL),mMaxReads(DEFAULT_MAX_READS),
+      mLastRead(0),mLastDenied(0),mDue()
+{
+}
+
+void gltop::IoAccounting::sample(std::map<int, Process> &processes)
+{
+    double now = getTime();
+    // A little slack, so a process read on the last scan is not skipped
+    // because this one came a few milliseconds early.
+    double interval = 0.9 * std::chrono::duration<double>(mInterval).count();
+
+    mDue.clear();
+    for(auto &[pid, proc] : processes)
+        if(now - proc.mIoTime >= interval && now >= proc.mIoRetry)
+            mDue.push_back(&proc);
+    // Over the limit: the ones unread for longest (or never) go first.
+    if(mDue.size() > mMaxReads)
+    {
+        std::nth_element(mDue.begin(), mDue.begin() + mMaxReads, mDue.end(),
+                         [](const Process *a, const Process *b)
+                         {
+                             return a->mIoTime < b->mIoTime;
+                         });
+        mDue.resize(mMaxReads);
+    }
+
+    mLastRead = 0;
+    mLastDenied = 0;
+    IoCounters io;
+    for(Process *proc : mDue)
+    {
+        if(!mReader.readIo(proc->getTID(), io))
+        {
+            if(errno == EACCES || errno == EPERM)
+            {
+                proc->mIoRetry = now + std::chrono::duration<double>
+                    (RETRY_INTERVAL).count();
+                mLastDenied++;
+            }
+            continue;
+        }
+
+        if(proc->mIoTime > 0.)
+        {
+            double seconds = now - proc->mIoTime;
+            auto &rates = proc->mIoRates;
+            rates.readBytes = getRate(proc->mIo.readBytes, io.readBytes,
+                                      seconds);
+            rates.writeBytes = getRate(proc->mIo.writeBytes, io.writeBytes,
+                                       seconds);
+            rates.syscr = getRate(proc->mIo.syscr, io.syscr, seconds);
+            rates.syscw = getRate(proc->mIo.syscw, io.syscw, seconds);
+        }
+        proc->mIo = io;
+        proc->mIoTime = now;
+        mLastRead++;
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef GLTOP_IO_HPP
+#define GLTOP_IO_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "procfs.hpp"
+
+namespace gltop
+{
+    class Process;
+
+    // Turns the /proc/<pid>/io counters into per second rates. Each
+    // process is read at most once per interval, and at most maxReads of
+    // them per sample, longest unread first, so a big table is covered
+    // over a few samples rather than all in one. Processes that are not
+    // ours to read are left alone for RETRY_INTERVAL rather than tried
+    // every sample.
+    class IoAccounting
+    {
+    public:
+        static constexpr std::chrono::seconds RETRY_INTERVAL
+            = std::chrono::seconds(30);
+        static constexpr std::chrono::milliseconds DEFAULT_INTERVAL
+            = std::chrono::milliseconds(1000);
+        static constexpr std::size_t DEFAULT_MAX_READS = 4096;
+
+        IoAccounting();
+
+        ~IoAccounting() = default;
+
+        IoAccounting(const IoAccounting &) = delete;
+        IoAccounting &operator=(const IoAccounting &) = delete;
+
+        // Read from another procfs root.
+        inline void setProcRoot(const std::string &root)
+        {
+            mReader.open(root);
+        }
+
+        // Shortest time between two reads of the same process.
+        inline void setInterval(std::chrono::milliseconds interval)
+        {
+            mInterval = interval;
+        }
+
+        // Most processes read per sample().
+        inline void setMaxReads(std::size_t maxReads)
+        {
+            mMaxReads = maxReads;
+        }
+
+        // Read the processes that are due and update their rates.
+        void sample(std::map<int, Process> &processes);
+
+        // Processes read by the last sample(), and those it found it may
+        // not read.
+        inline std::size_t getLastRead() const
+        {
+            return mLastRead;
+        }
+
+        inline std::size_t getLastDenied() const
+        {
+            return mLastDenied;
+        }
+
+    private:
+        ProcReader mReader;
+        std::chrono::milliseconds mInterval;
+        std::size_t mMaxReads;
+        std::size_t mLastRead;
+        std::size_t mLastDenied;
+        // Processes due this sample.
+        std::vector<Process *> mDue;
+    };
+}
+
+#endif /* GLTOP_IO_HPP */
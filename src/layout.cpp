@@ -0,0 +1,32 @@
+#include <cmath>
+
+#include "layout.hpp"
+
+namespace
+{
+    // Between siblings.
+    constexpr float SIBLING_ANGLE = 15.f * 3.14159265359f / 180.f;
+}
+
+gltop::MapLayout::MapLayout()
+    : mPositions()
+{
+}
+
+gltop::MapPoint gltop::MapLayout::getPosition(int depth, int siblingIndex)
+{
+    if(depth == 0)
+        return MapPoint();
+    const float angle = SIBLING_ANGLE * static_cast<float>(siblingIndex + 1);
+    return MapPoint{RADIUS * std::cos(angle), RADIUS * std::sin(angle),
+                    DZ * static_cast<float>(depth)};
+}
+
+void gltop::MapLayout::layout(const ProcessStore &store, ProcessView root)
+{
+    mPositions.clear();
+    if(!root)
+        return;
+    for(auto slot : root.getSubtree())
+        mPositions.push_back(getPosition(store.get(slot), root.getDepth()));
+}
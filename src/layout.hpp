@@ -0,0 +1,56 @@
+#ifndef GLTOP_LAYOUT_HPP
+#define GLTOP_LAYOUT_HPP
+
+#include <vector>
+
+#include "store.hpp"
+
+namespace gltop
+{
+    // A point in map space.
+    struct MapPoint
+    {
+        float x = 0.f;
+        float y = 0.f;
+        float z = 0.f;
+    };
+
+    // Where each process sits on the map: children fan out around the
+    // axis from the root at the origin, one level of depth every DZ.
+    // Works on a ProcessStore alone, so it runs without a GL context.
+    class MapLayout
+    {
+    public:
+        static constexpr float DZ = 35.f;
+        static constexpr float RADIUS = 100.f;
+
+        MapLayout();
+
+        // Position of the siblingIndex'th child depth levels below the
+        // root.
+        static MapPoint getPosition(int depth, int siblingIndex);
+
+        static inline MapPoint getPosition(ProcessView proc, int rootDepth)
+        {
+            return getPosition(proc.getDepth() - rootDepth,
+                               proc.getSiblingIndex());
+        }
+
+        // Work out where every process under root (one of store's) sits.
+        // Walks the store's preorder, so deep trees do not recurse. A NULL
+        // root empties the layout.
+        void layout(const ProcessStore &store, ProcessView root);
+
+        // Positions from the last layout(), in the order root.getSubtree()
+        // visits the processes.
+        inline const std::vector<MapPoint> &getPositions() const
+        {
+            return mPositions;
+        }
+
+    private:
+        std::vector<MapPoint> mPositions;
+    };
+}
+
+#endif /* GLTOP_LAYOUT_HPP */
@@ -6,6 +6,7 @@ extern "C" {
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <unistd.h>
 #include <iostream>
 #include <cmath>
 #include <random>
@@ -17,16 +18,19 @@ extern "C" {
 #include <tuple>
 #include <iomanip>
 #include <map>
+#include <set>
 #include <glm/glm.hpp>
-#include <fstream>
 #include "loadobj.hpp"
 
 #include "util.hpp"
 
 
 #include "gltop.hpp"
+#include "collector.hpp"
 #include "util.hpp"
 #include "loadobj.hpp"
+#include "bmptotexture.hpp"
+#include "layout.hpp"
 
 using namespace std::chrono_literals;
 using namespace std::string_literals;
@@ -270,39 +274,111 @@ int     TyrantHeight;           // Tyrant's texture height.
 GLuint  TyrantTexID;            // Tyrant's OpenGL teture ID.
 
 static std::string parentName;
-static std::map<int, gltop::Process> processes;
+// Samples /proc in the background; Display() draws its latest snapshot.
+static gltop::Collector collector(1000ms);
+static const gltop::ProcessStore *processes = nullptr;
+static const gltop::SystemStats *systemStats = nullptr;
+static const gltop::Snapshot *lastSnapshot = nullptr;
+// In cgroup mode the map shows cgroups, with their processes around them.
+static bool cgroupMode = false;
+static const std::vector<gltop::Cgroup> *cgroups = nullptr;
+// Tint processes by their I/O rate instead of their CPU use.
+static bool colorByIo = false;
+// With PSS on, labels show it, marked with its age once stale.
+static bool memoryDetail = false;
+// The process picked with [ and ] (0 for none), and those e has asked the
+// collector to read the threads of.
+static int selectedPid = 0;
+static std::set<int> expandedPids;
+
+// Frame times, reported to stderr every FRAME_REPORT_INTERVAL with
+// --frame-stats.
+constexpr auto FRAME_REPORT_INTERVAL = 5s;
+static bool frameStats = false;
+static gltop::RollingStats frameTimes;
+static chron::steady_clock::time_point lastFrame;
+static chron::steady_clock::time_point lastFrameReport;
 
 static gltop::Timer animTimer(1000ms);
-static gltop::Timer procTimer(1000ms, [](float f)
+
+// Performance HUD. The timings (ms) are only collected while it is on;
+// otherwise the timers are given nothing and never read the clock.
+static bool hudOn = false;
+struct HudTimings
 {
-    processes.clear();
-    gltop::Proctab allTab;
-    for(auto proc = allTab.getNextProcess(); proc;
-        proc = allTab.getNextProcess())
-        processes[proc.getTID()] = proc;
-    // Ensure each process in processes has its children 
-    for(auto &[tid, proc] : processes)
-    {
-        if(proc.getTID() <= 2)
-            continue;
-        auto parentIter = processes.find(proc.getPPID());
-        if(parentIter == processes.end())
-            std::cerr << "Could not find parent of tid " << proc.getTID()
-                      << " with ppid " << proc.getPPID() << '\n';
-        else
-            parentIter->second.addChild(tid);
-    }
-});
+    gltop::RollingStats scan{256};
+    gltop::RollingStats build{256};
+    gltop::RollingStats layout{256};
+    gltop::RollingStats draw{256};
+    gltop::RollingStats swap{256};
+    gltop::RollingStats frame{256};
+    // gltop's own RSS (kB) and CPU use (%), read for itself rather than
+    // looked up in the snapshot, which a filter or --proc-root can leave
+    // it out of. CPU use is over the last SELF_INTERVAL or so.
+    unsigned long selfRss = 0;
+    float selfCpu = 0.f;
+    chron::nanoseconds selfCpuTime{0};
+    chron::steady_clock::time_point selfTime;
+};
+static HudTimings hud;
+static constexpr chron::seconds SELF_INTERVAL(1);
+// Snapshot whose scan and build times have been added.
+static std::uint64_t hudSequence = 0;
+
+// Stats to time into, if the HUD is on.
+inline gltop::RollingStats *hudStats(gltop::RollingStats &stats)
+{
+    return hudOn ? &stats : nullptr;
+}
 // function prototypes:
 
+// Get a process from the current snapshot (a NULL process if it is not
+// there).
+gltop::ProcessView getProcess(int pid)
+{
+    return processes->getProcess(pid);
+}
+
+// Move the selection step processes on through the map, wrapping around.
+// With nothing (or a process since gone) selected, start at either end.
+// The selection's PSS is read first each scan, so its label stays fresh.
+void selectProcess(int step)
+{
+    // Nothing to select before the first snapshot.
+    if(!processes)
+        return;
+    const auto root = getProcess(1);
+    if(!root)
+        return;
+    const auto subtree = root.getSubtree();
+    const int size = static_cast<int>(subtree.size());
+    int at = -1;
+    for(int i = 0; i < size && at < 0; i++)
+        if(processes->get(subtree[i]).getTID() == selectedPid)
+            at = i;
+    at = (at < 0) ? ((step > 0) ? 0 : size - 1)
+        : ((at + step) % size + size) % size;
+    if(selectedPid)
+        collector.setMemoryPriority(selectedPid, false);
+    selectedPid = processes->get(subtree[at]).getTID();
+    collector.setMemoryPriority(selectedPid, true);
+}
+
+// Read the selected process's threads every scan, or stop.
+void toggleExpanded()
+{
+    if(!selectedPid)
+        return;
+    const bool expanded = expandedPids.insert(selectedPid).second;
+    if(!expanded)
+        expandedPids.erase(selectedPid);
+    collector.setExpanded(selectedPid, expanded);
+}
+
 // Get number of descendant processes. 
-std::size_t getNumChildrenAfter(const gltop::Process &proc)
+std::size_t getNumChildrenAfter(gltop::ProcessView proc)
 {
-    auto childPIDs = proc.getChildrenPids();
-    std::size_t sum = childPIDs.size();
-    for(auto i : childPIDs)
-        sum += getNumChildrenAfter(processes[i]);
-    return sum;
+    return static_cast<std::size_t>(proc.getSubtreeSize() - 1);
 }
 
 
@@ -331,10 +407,7 @@ void	Resize( int, int );
 void	Visibility( int );
 
 void			Axes( float );
-unsigned char *	BmpToTexture( const char *, int *, int * );
 void			HsvRgb( float[3], float [3] );
-int				ReadInt( FILE * );
-short			ReadShort( FILE * );
 
 void			Cross(float[3], float[3], float[3]);
 float			Dot(float [3], float [3]);
@@ -381,60 +454,236 @@ struct thing
     }
 };
 
-static int totalMem = 0;
 static thing cuckoo;
 static thing tomato;
 
-// Draw all the processes.
-constexpr GLfloat DZ = 35.f;
-void drawMap(GLfloat x = 0.f, GLfloat y = 0.f,
-             GLfloat z = 0.f, int procID = 1)
+// Where every process sits on the map, worked out each frame.
+static gltop::MapLayout mapLayout;
+constexpr GLfloat RADIUS = gltop::MapLayout::RADIUS;
+
+gltop::MapPoint getMapPosition(int depth, int siblingIndex)
+{
+    return gltop::MapLayout::getPosition(depth, siblingIndex);
+}
+
+// Work out where every process under root sits.
+void layoutMap(gltop::ProcessView root = getProcess(1))
 {
-    const auto &proc = processes[procID];
-    const auto basename = proc.getBasename();
-    const auto childrenPIDs = proc.getChildrenPids();
-    glPushMatrix();
-    glTranslatef(x, y, z);
-    glRotatef(deg2rad(2.f) * (static_cast<float>(totalMem)
-                              / static_cast<float>(proc.getVMem())) *
-              glm::sin(animTimer.getElapsedNormalized() * deg2rad(360.f)),
-              0.f, 0.f, 1.f);
-    glBegin(GL_POINT);
-    glVertex3f(0.f, 0.f, 0.f);
+    mapLayout.layout(*processes, root);
+}
+
+// Draw all the processes under root, depth first, where layoutMap() put
+// them.
+void drawMap(gltop::ProcessView root = getProcess(1))
+{
+    const auto &mapPositions = mapLayout.getPositions();
+    if(!root || root.getSubtree().size() != mapPositions.size())
+        return;
+    std::size_t i = 0;
+    for(auto slot : root.getSubtree())
+    {
+        const auto proc = processes->get(slot);
+        const auto pos = mapPositions[i++];
+        const auto basename = proc.getBasename();
+        // Wobble by how small a share of memory the process uses (its PSS
+        // once known, else what it maps); kernel threads sit still.
+        const unsigned long mem = (proc.hasMemoryDetail() && proc.getPSS())
+            ? proc.getPSS() : proc.getVMem();
+        const GLfloat wobble = mem
+            ? static_cast<float>(systemStats->memTotal)
+                / static_cast<float>(mem)
+            : 0.f;
+        glPushMatrix();
+        glTranslatef(pos.x, pos.y, pos.z);
+        glRotatef(deg2rad(2.f) * wobble *
+                  glm::sin(animTimer.getElapsedNormalized() * deg2rad(360.f)),
+                  0.f, 0.f, 1.f);
+        glBegin(GL_POINT);
+        glVertex3f(0.f, 0.f, 0.f);
+        glEnd();
+        // Tint busy processes red by their CPU use over the last interval,
+        // or by their I/O on a log scale up to 100MB/s.
+        const GLfloat heat = colorByIo
+            ? std::min(std::log10(1.f + proc.getIoRead() + proc.getIoWrite())
+                       / 8.f, 1.f)
+            : std::sqrt(std::min(proc.getCPU() / 100.f, 1.f));
+        glColor3f(1.f, 1.f - heat, 1.f - heat);
+        cuckoo.draw();
+        glPopMatrix();
+
+        // The selection is labelled in yellow, names on or not, with its
+        // threads (once read) listed under it.
+        const bool selected = proc.getTID() == selectedPid;
+        if(selected)
+            glColor3f(1.f, 1.f, 0.f);
+        glRasterPos3f(pos.x, pos.y, pos.z);
+        if(!basename.empty() && (drawNames || selected))
+            glutBitmapString(GLUT_BITMAP_TIMES_ROMAN_24,
+                             reinterpret_cast<const unsigned char *>
+                             (basename.data()));
+        if(memoryDetail && drawNames && proc.hasMemoryDetail())
+        {
+            // Scans come at whatever interval the scheduler picks, and
+            // PSS reads stop while it sheds load, so age by the clock.
+            char label[48];
+            const auto age = lastSnapshot->time - proc.getMemoryTime();
+            if(age < chron::seconds(1))
+                std::snprintf(label, sizeof(label), " pss %luM uss %luM",
+                              proc.getPSS() / 1024, proc.getUSS() / 1024);
+            else
+                std::snprintf(label, sizeof(label),
+                              " pss %luM uss %luM (%llds old)",
+                              proc.getPSS() / 1024, proc.getUSS() / 1024,
+                              static_cast<long long>
+                              (chron::duration_cast<chron::seconds>(age)
+                               .count()));
+            glutBitmapString(GLUT_BITMAP_HELVETICA_12,
+                             reinterpret_cast<const unsigned char *>(label));
+        }
+        if(selected)
+        {
+            GLfloat line = 0.f;
+            for(const auto &thread : proc.getThreads())
+            {
+                char label[64];
+                std::snprintf(label, sizeof(label), "%d %s %c %.1f%%",
+                              thread.tid, thread.cmd, thread.state,
+                              thread.cpu);
+                line += 16.f;
+                glRasterPos3f(pos.x, pos.y, pos.z);
+                glBitmap(0, 0, 0.f, 0.f, 0.f, -line, nullptr);
+                glutBitmapString(GLUT_BITMAP_HELVETICA_12,
+                                 reinterpret_cast<const unsigned char *>
+                                 (label));
+            }
+        }
+    }
+}
+
+// The map's points, in the order drawMap() visits them.
+void drawMapPts()
+{
+    for(const auto &pos : mapLayout.getPositions())
+        glVertex3f(pos.x, pos.y, pos.z);
+}
+
+// Draw the cgroup tree, each cgroup sized by its share of memory and
+// tinted by its CPU use, with its own processes in a ring around it.
+void drawCgroups()
+{
+    const float memTotal = static_cast<float>(systemStats->memTotal) * 1024.f;
+    glBegin(GL_LINES);
+    glColor3f(1.f, 1.f, 1.f);
+    for(const auto &cgroup : *cgroups)
+    {
+        if(cgroup.parent < 0)
+            continue;
+        const auto &parent = (*cgroups)[cgroup.parent];
+        const auto from = getMapPosition(parent.depth, parent.siblingIndex);
+        const auto to = getMapPosition(cgroup.depth, cgroup.siblingIndex);
+        glVertex3f(from.x, from.y, from.z);
+        glVertex3f(to.x, to.y, to.z);
+    }
     glEnd();
-    cuckoo.draw();
-    glPopMatrix();
-
-    glRasterPos3f(x, y, z);
-    if(!basename.empty() && drawNames)
-        glutBitmapString(GLUT_BITMAP_TIMES_ROMAN_24,
-                         reinterpret_cast<const unsigned char *>(basename.c_str()));
-
-    GLfloat dx = 0.f;
-    GLfloat dy = 0.f;
-    constexpr GLfloat RADIUS = 100.f;
-    for(auto i : childrenPIDs)
-        drawMap(RADIUS * glm::cos((dx += deg2rad(15.f))),
-                RADIUS * glm::sin((dy += deg2rad(15.f))),
-                z + DZ,
-                i);
+
+    for(const auto &cgroup : *cgroups)
+    {
+        const auto pos = getMapPosition(cgroup.depth, cgroup.siblingIndex);
+        const GLfloat share = (memTotal > 0.f)
+            ? std::min(static_cast<float>(cgroup.stats.memory) / memTotal,
+                       1.f)
+            : 0.f;
+        const GLfloat scale = 1.f + 4.f * std::sqrt(share);
+        const GLfloat heat = std::sqrt(std::min(cgroup.cpu / 100.f, 1.f));
+        glPushMatrix();
+        glTranslatef(pos.x, pos.y, pos.z);
+        glScalef(scale, scale, scale);
+        glColor3f(1.f, 1.f - heat, 1.f - heat);
+        tomato.draw();
+        glPopMatrix();
+
+        for(std::size_t i = 0; i < cgroup.pids.size(); i++)
+        {
+            const auto proc = getProcess(cgroup.pids[i]);
+            if(!proc)
+                continue;
+            const GLfloat angle = deg2rad(360.f) * static_cast<float>(i)
+                / static_cast<float>(cgroup.pids.size());
+            const GLfloat procHeat
+                = std::sqrt(std::min(proc.getCPU() / 100.f, 1.f));
+            glPushMatrix();
+            glTranslatef(pos.x + RADIUS / 4.f * glm::cos(angle),
+                         pos.y + RADIUS / 4.f * glm::sin(angle), pos.z);
+            glScalef(0.5f, 0.5f, 0.5f);
+            glColor3f(1.f, 1.f - procHeat, 1.f - procHeat);
+            cuckoo.draw();
+            glPopMatrix();
+        }
+
+        // The name ends the path, so it is NUL terminated.
+        const auto name = cgroup.getName();
+        glColor3f(1.f, 1.f, 1.f);
+        glRasterPos3f(pos.x, pos.y, pos.z);
+        if(drawNames)
+            glutBitmapString(GLUT_BITMAP_TIMES_ROMAN_24,
+                             reinterpret_cast<const unsigned char *>
+                             (name.data()));
+    }
 }
 
-void drawMapPts(GLfloat x = 0.f, GLfloat y = 0.f,
-                GLfloat z = 0.f, int procID = 1)
+// Draw the HUD into the 0-100 overlay: rolling p50 and p99 of each stage,
+// then the process count, frame rate and gltop's own RSS and CPU.
+void drawHud()
 {
-    const auto &proc = processes[procID];
-    const auto childrenPIDs = proc.getChildrenPids();
-    glVertex3f(x, y, z);
-
-    GLfloat dx = 0.f;
-    GLfloat dy = 0.f;
-    constexpr GLfloat RADIUS = 100.f;
-    for(auto i : childrenPIDs)
-        drawMapPts(RADIUS*glm::cos((dx += deg2rad(15.f))),
-                   RADIUS*glm::sin((dy += deg2rad(15.f))),
-                   z + DZ,
-                   i);
+    struct Row
+    {
+        const char *name;
+        gltop::RollingStats *stats;
+    };
+    const Row rows[] = {
+        { "/proc scan", &hud.scan },
+        { "tree build", &hud.build },
+        { "layout", &hud.layout },
+        { "draw", &hud.draw },
+        { "swap", &hud.swap },
+        { "frame", &hud.frame },
+    };
+
+    char line[128];
+    float y = 97.f;
+    glColor3f(1.f, 1.f, 0.f);
+    for(const auto &row : rows)
+    {
+        std::snprintf(line, sizeof(line), "%-10s p50 %7.3fms  p99 %7.3fms",
+                      row.name, row.stats->getPercentile(50.f),
+                      row.stats->getPercentile(99.f));
+        glRasterPos2f(1.f, y);
+        glutBitmapString(GLUT_BITMAP_HELVETICA_12,
+                         reinterpret_cast<const unsigned char *>(line));
+        y -= 3.f;
+    }
+
+    const auto now = chron::steady_clock::now();
+    if(now - hud.selfTime >= SELF_INTERVAL)
+    {
+        const auto cpuTime = gltop::getProcessTime();
+        if(hud.selfTime != chron::steady_clock::time_point())
+            hud.selfCpu = 100.f
+                * chron::duration<float>(cpuTime - hud.selfCpuTime).count()
+                / chron::duration<float>(now - hud.selfTime).count();
+        hud.selfCpuTime = cpuTime;
+        hud.selfTime = now;
+        hud.selfRss = gltop::getSelfRSS();
+    }
+
+    const float frameMs = hud.frame.getPercentile(50.f);
+    std::snprintf(line, sizeof(line),
+                  "%zu processes, %.1f fps, gltop %luM RSS %.1f%% CPU",
+                  processes->size(), frameMs > 0.f ? 1000.f / frameMs : 0.f,
+                  hud.selfRss / 1024, hud.selfCpu);
+    glRasterPos2f(1.f, y);
+    glutBitmapString(GLUT_BITMAP_HELVETICA_12,
+                     reinterpret_cast<const unsigned char *>(line));
 }
 
 // main program:
@@ -448,6 +697,75 @@ main( int argc, char *argv[ ] )
 
 	glutInit( &argc, argv );
 
+	// handle our own command line arguments:
+
+	std::string userFilter, nameFilter;
+	for( int i = 1; i < argc; i++ )
+	{
+		std::string arg = argv[i];
+		if( arg == "--scan-threads" && i + 1 < argc )
+			collector.setScanThreads( std::max( 1, atoi( argv[++i] ) ) );
+		else if( arg == "--proc-events" )
+			collector.setUseEvents( true );
+		else if( arg == "--threads" )
+			collector.setThreadMode( true );
+		else if( arg == "--cpu-budget" && i + 1 < argc )
+			collector.setCpuBudget( (float)atof( argv[++i] ) );
+		else if( arg == "--io" )
+		{
+			colorByIo = true;
+			collector.setIoSampling( true );
+		}
+		else if( arg == "--pss" )
+		{
+			memoryDetail = true;
+			collector.setMemoryDetail( true );
+		}
+		else if( arg == "--pss-cpu-cap" && i + 1 < argc )
+		{
+			memoryDetail = true;
+			collector.setMemoryDetail( true, (float)atof( argv[++i] ) );
+		}
+		else if( arg == "--cgroups" )
+		{
+			cgroupMode = true;
+			collector.setCgroupMode( true );
+		}
+		else if( arg == "--cgroup-root" && i + 1 < argc )
+		{
+			cgroupMode = true;
+			collector.setCgroupMode( true, argv[++i] );
+		}
+		else if( arg == "--proc-root" && i + 1 < argc )
+			collector.setProcRoot( argv[++i] );
+		else if( arg == "--history-mb" && i + 1 < argc )
+			collector.setHistory( gltop::Collector::DEFAULT_HISTORY_DEPTH,
+				(size_t)std::max( 1, atoi( argv[++i] ) ) << 20 );
+		else if( arg == "--record" && i + 1 < argc )
+			collector.setRecordPath( argv[++i] );
+		else if( arg == "--frame-stats" )
+			frameStats = true;
+		else if( arg == "--user" && i + 1 < argc )
+			userFilter = argv[++i];
+		else if( arg == "--name" && i + 1 < argc )
+			nameFilter = argv[++i];
+		else
+			fprintf( stderr, "Don't know what to do with argument '%s'\n", argv[i] );
+	}
+
+	if( !userFilter.empty( ) || !nameFilter.empty( ) )
+	{
+		try
+		{
+			collector.setFilter( userFilter, nameFilter );
+		}
+		catch( std::exception &e )
+		{
+			fprintf( stderr, "%s\n", e.what( ) );
+			return 1;
+		}
+	}
+
 	// setup all the graphics stuff:
 
 	InitGraphics( );
@@ -469,6 +787,10 @@ main( int argc, char *argv[ ] )
 	// draw the scene once and wait for some interaction:
 	// (this will never return)
 
+	// start sampling processes in the background:
+
+	collector.start( );
+
 	glutSetWindow( MainWindow );
 	glutMainLoop();
 
@@ -495,7 +817,6 @@ void Animate()
 	// put animation stuff in here -- change some global variables
 	// for Display( ) to find:
     animTimer.elapseAnimateNormalized();
-    procTimer.elapseAnimateNormalized();
 	glutSetWindow(MainWindow);
 	glutPostRedisplay();
 }
@@ -517,6 +838,23 @@ void Display()
 	glutSetWindow( MainWindow );
 
 
+	// pick up the collector's latest snapshot (never blocks):
+
+	const gltop::Snapshot &snapshot = collector.acquire( );
+	lastSnapshot = &snapshot;
+	processes = &snapshot.processes;
+	systemStats = &snapshot.system;
+	cgroups = &snapshot.cgroups;
+	if( hudOn && snapshot.sequence != hudSequence )
+	{
+		// Snapshots published for events had no scan to time.
+		if( snapshot.refreshTime != gltop::Snapshot::clock::duration::zero( ) )
+			hud.scan.add( chron::duration<float, std::milli>( snapshot.refreshTime ).count( ) );
+		hud.build.add( chron::duration<float, std::milli>( snapshot.buildTime ).count( ) );
+		hudSequence = snapshot.sequence;
+	}
+
+
 	// erase the background:
 
 	glDrawBuffer( GL_BACK );
@@ -611,13 +949,26 @@ void Display()
 		glCallList( AxesList );
 	}
 
-    drawMap();
+    if(cgroupMode)
+    {
+        gltop::ScopedTimer drawTimer(hudStats(hud.draw));
+        drawCgroups();
+    }
+    else
+    {
+        {
+            gltop::ScopedTimer layoutTimer(hudStats(hud.layout));
+            layoutMap();
+        }
+        gltop::ScopedTimer drawTimer(hudStats(hud.draw));
+        drawMap();
 
-    glBegin(GL_LINE_STRIP);
-    glLineWidth(5.f);
-    glColor3f(1.f, 1.f, 1.f);
-    drawMapPts();
-    glEnd();
+        glBegin(GL_LINE_STRIP);
+        glLineWidth(5.f);
+        glColor3f(1.f, 1.f, 1.f);
+        drawMapPts();
+        glEnd();
+    }
 
 
     glTranslatef(0.f, 0.f, 0.f);
@@ -633,16 +984,63 @@ void Display()
 	glLoadIdentity( );
 	glColor3f( 1., 1., 1. );
 
+	// possibly draw the performance HUD:
+
+	if( hudOn )
+		drawHud( );
+
+
+	// show what the scan scheduler picked and what scans cost:
+
+	if( lastSnapshot->sequence != 0 )
+	{
+		char status[128];
+		snprintf( status, sizeof(status),
+			"scan every %lldms, %.2fms CPU (%.2f%% of a core)%s",
+			(long long)lastSnapshot->interval.count( ),
+			chron::duration<float, std::milli>( lastSnapshot->scanCost ).count( ),
+			lastSnapshot->scanUsage,
+			lastSnapshot->shedding ? ", shedding I/O, PSS and cgroups" : "" );
+		glRasterPos2f( 1.f, 1.f );
+		glutBitmapString( GLUT_BITMAP_HELVETICA_12, (const unsigned char *)status );
+	}
+
 
 	// swap the double-buffered framebuffers:
 
-	glutSwapBuffers( );
+	{
+		gltop::ScopedTimer swapTimer( hudStats( hud.swap ) );
+		glutSwapBuffers( );
+	}
 
 
 	// be sure the graphics buffer has been sent:
 	// note: be sure to use glFlush( ) here, not glFinish( ) !
 
 	glFlush( );
+
+
+	// keep track of frame times, so hitches show up:
+
+	auto now = chron::steady_clock::now( );
+	if( lastFrame != chron::steady_clock::time_point( ) )
+	{
+		const float frameMs = chron::duration<float, std::milli>( now - lastFrame ).count( );
+		if( frameStats )
+			frameTimes.add( frameMs );
+		if( hudOn )
+			hud.frame.add( frameMs );
+	}
+	lastFrame = now;
+	if( frameStats && now - lastFrameReport >= FRAME_REPORT_INTERVAL && frameTimes.getCount( ) )
+	{
+		fprintf( stderr, "Frame times (sampling %s): p50 %.2fms p90 %.2fms p99 %.2fms max %.2fms\n",
+			collector.isPaused( ) ? "off" : "on",
+			frameTimes.getPercentile( 50.f ), frameTimes.getPercentile( 90.f ),
+			frameTimes.getPercentile( 99.f ), frameTimes.getPercentile( 100.f ) );
+		frameTimes.clear( );
+		lastFrameReport = now;
+	}
 }
 
 
@@ -1125,31 +1523,6 @@ void
 InitLists( )
 {
 
-    std::ifstream meminfo("/proc/meminfo");
-    if(meminfo)
-    {
-        std::string r1;
-        std::string r2;
-        std::string r3;
-
-        // Read the first line of meminfo.
-        meminfo >> r1 >> r2 >> r3;
-
-        try
-        {
-            totalMem = std::stoi(r2);
-            std::cout << "System has " << totalMem << "kb of memory.\n";
-        }
-        catch(std::invalid_argument &e)
-        {
-            std::cerr << "Could not get system memory, setting to 0.\n";
-        }
-
-    }
-    else
-       std::cerr << "Could not get system memory, setting to 0.\n";
-            
-
     cuckoo.create("chicken.obj", "chicken.bmp");
     tomato.create("toemato.obj", "toemato.bmp");
     TeapotList = glGenLists(1);
@@ -1252,6 +1625,36 @@ Keyboard(unsigned char c, int x, int y)
     case 'T':
         drawNames = !drawNames;
         break;
+    case 'h':
+    case 'H':
+        // Start the HUD's figures afresh each time it is shown.
+        hudOn = !hudOn;
+        hud = HudTimings();
+        break;
+    case 'i':
+    case 'I':
+        // Only has I/O to show when started with --io.
+        colorByIo = !colorByIo;
+        break;
+    case '[':
+        selectProcess(-1);
+        break;
+    case ']':
+        selectProcess(1);
+        break;
+    case 'e':
+    case 'E':
+        // List the selected process's threads, even out of --threads.
+        toggleExpanded();
+        break;
+    case 'p':
+    case 'P':
+        // Toggle sampling; restart the frame time stats so they only cover
+        // one mode.
+        collector.setPaused(!collector.isPaused());
+        frameTimes.clear();
+        lastFrameReport = chron::steady_clock::now();
+        break;
 
     default:
         fprintf( stderr, "Don't know what to do with keyboard hit: '%c' (0x%0x)\n", c, c );
@@ -1537,252 +1940,6 @@ Axes( float length )
 }
 
 
-// read a BMP file into a Texture:
-
-#define VERBOSE		false
-#define BMP_MAGIC_NUMBER	0x4d42
-#ifndef BI_RGB
-#define BI_RGB			0
-#define BI_RLE8			1
-#define BI_RLE4			2
-#endif
-
-
-// bmp file header:
-struct bmfh
-{
-	short bfType;		// BMP_MAGIC_NUMBER = "BM"
-	int bfSize;		// size of this file in bytes
-	short bfReserved1;
-	short bfReserved2;
-	int bfOffBytes;		// # bytes to get to the start of the per-pixel data
-} FileHeader;
-
-// bmp info header:
-struct bmih
-{
-	int biSize;		// info header size, should be 40
-	int biWidth;		// image width
-	int biHeight;		// image height
-	short biPlanes;		// #color planes, should be 1
-	short biBitCount;	// #bits/pixel, should be 1, 4, 8, 16, 24, 32
-	int biCompression;	// BI_RGB, BI_RLE4, BI_RLE8
-	int biSizeImage;
-	int biXPixelsPerMeter;
-	int biYPixelsPerMeter;
-	int biClrUsed;		// # colors in the palette
-	int biClrImportant;
-} InfoHeader;
-
-
-
-// read a BMP file into a Texture:
-
-unsigned char *
-BmpToTexture( const char *filename, int *width, int *height )
-{
-	FILE *fp;
-#ifdef _WIN32
-        errno_t err = fopen_s( &fp, filename, "rb" );
-        if( err != 0 )
-        {
-		fprintf( stderr, "Cannot open Bmp file '%s'\n", filename );
-		return NULL;
-        }
-#else
-	fp = fopen( filename, "rb" );
-	if( fp == NULL )
-	{
-		fprintf( stderr, "Cannot open Bmp file '%s'\n", filename );
-		return NULL;
-	}
-#endif
-
-	FileHeader.bfType = ReadShort( fp );
-
-
-	// if bfType is not BMP_MAGIC_NUMBER, the file is not a bmp:
-
-	if( VERBOSE ) fprintf( stderr, "FileHeader.bfType = 0x%0x = \"%c%c\"\n",
-			FileHeader.bfType, FileHeader.bfType&0xff, (FileHeader.bfType>>8)&0xff );
-	if( FileHeader.bfType != BMP_MAGIC_NUMBER )
-	{
-		fprintf( stderr, "Wrong type of file: 0x%0x\n", FileHeader.bfType );
-		fclose( fp );
-		return NULL;
-	}
-
-
-	FileHeader.bfSize = ReadInt( fp );
-	if( VERBOSE )	fprintf( stderr, "FileHeader.bfSize = %d\n", FileHeader.bfSize );
-
-	FileHeader.bfReserved1 = ReadShort( fp );
-	FileHeader.bfReserved2 = ReadShort( fp );
-
-	FileHeader.bfOffBytes = ReadInt( fp );
-	if( VERBOSE )	fprintf( stderr, "FileHeader.bfOffBytes = %d\n", FileHeader.bfOffBytes );
-
-
-	InfoHeader.biSize = ReadInt( fp );
-	if( VERBOSE )	fprintf( stderr, "InfoHeader.biSize = %d\n", InfoHeader.biSize );
-	InfoHeader.biWidth = ReadInt( fp );
-	if( VERBOSE )	fprintf( stderr, "InfoHeader.biWidth = %d\n", InfoHeader.biWidth );
-	InfoHeader.biHeight = ReadInt( fp );
-	if( VERBOSE )	fprintf( stderr, "InfoHeader.biHeight = %d\n", InfoHeader.biHeight );
-
-	const int nums = InfoHeader.biWidth;
-	const int numt = InfoHeader.biHeight;
-
-	InfoHeader.biPlanes = ReadShort( fp );
-	if( VERBOSE )	fprintf( stderr, "InfoHeader.biPlanes = %d\n", InfoHeader.biPlanes );
-
-	InfoHeader.biBitCount = ReadShort( fp );
-	if( VERBOSE )	fprintf( stderr, "InfoHeader.biBitCount = %d\n", InfoHeader.biBitCount );
-
-	InfoHeader.biCompression = ReadInt( fp );
-	if( VERBOSE )	fprintf( stderr, "InfoHeader.biCompression = %d\n", InfoHeader.biCompression );
-
-	InfoHeader.biSizeImage = ReadInt( fp );
-	if( VERBOSE )	fprintf( stderr, "InfoHeader.biSizeImage = %d\n", InfoHeader.biSizeImage );
-
-	InfoHeader.biXPixelsPerMeter = ReadInt( fp );
-	InfoHeader.biYPixelsPerMeter = ReadInt( fp );
-
-	InfoHeader.biClrUsed = ReadInt( fp );
-	if( VERBOSE )	fprintf( stderr, "InfoHeader.biClrUsed = %d\n", InfoHeader.biClrUsed );
-
-	InfoHeader.biClrImportant = ReadInt( fp );
-
-
-	// fprintf( stderr, "Image size found: %d x %d\n", ImageWidth, ImageHeight );
-
-
-	// pixels will be stored bottom-to-top, left-to-right:
-	unsigned char *texture = new unsigned char[ 3 * nums * numt ];
-	if( texture == NULL )
-	{
-		fprintf( stderr, "Cannot allocate the texture array!\n" );
-		return NULL;
-	}
-
-	// extra padding bytes:
-
-	int requiredRowSizeInBytes = 4 * ( ( InfoHeader.biBitCount*InfoHeader.biWidth + 31 ) / 32 );
-	if( VERBOSE )	fprintf( stderr, "requiredRowSizeInBytes = %d\n", requiredRowSizeInBytes );
-
-	int myRowSizeInBytes = ( InfoHeader.biBitCount*InfoHeader.biWidth + 7 ) / 8;
-	if( VERBOSE )	fprintf( stderr, "myRowSizeInBytes = %d\n", myRowSizeInBytes );
-
-	int oldNumExtra =  4*(( (3*InfoHeader.biWidth)+3)/4) - 3*InfoHeader.biWidth;
-	if( VERBOSE )	fprintf( stderr, "Old NumExtra padding = %d\n", oldNumExtra );
-
-	int numExtra = requiredRowSizeInBytes - myRowSizeInBytes;
-	if( VERBOSE )	fprintf( stderr, "New NumExtra padding = %d\n", numExtra );
-
-
-	// this function does not support compression:
-
-	if( InfoHeader.biCompression != 0 )
-	{
-		fprintf( stderr, "Wrong type of image compression: %d\n", InfoHeader.biCompression );
-		fclose( fp );
-		return NULL;
-	}
-	
-
-	// we can handle 24 bits of direct color:
-	if( InfoHeader.biBitCount == 24 )
-	{
-		rewind( fp );
-		fseek( fp, FileHeader.bfOffBytes, SEEK_SET );
-		int t;
-		unsigned char *tp;
-		for( t = 0, tp = texture; t < numt; t++ )
-		{
-			for( int s = 0; s < nums; s++, tp += 3 )
-			{
-				*(tp+2) = fgetc( fp );		// b
-				*(tp+1) = fgetc( fp );		// g
-				*(tp+0) = fgetc( fp );		// r
-			}
-
-			for( int e = 0; e < numExtra; e++ )
-			{
-				fgetc( fp );
-			}
-		}
-	}
-
-	// we can also handle 8 bits of indirect color:
-	if( InfoHeader.biBitCount == 8 && InfoHeader.biClrUsed == 256 )
-	{
-		struct rgba32
-		{
-			unsigned char r, g, b, a;
-		};
-		struct rgba32 *colorTable = new struct rgba32[ InfoHeader.biClrUsed ];
-
-		rewind( fp );
-		fseek( fp, sizeof(struct bmfh) + InfoHeader.biSize - 2, SEEK_SET );
-		for( int c = 0; c < InfoHeader.biClrUsed; c++ )
-		{
-			colorTable[c].r = fgetc( fp );
-			colorTable[c].g = fgetc( fp );
-			colorTable[c].b = fgetc( fp );
-			colorTable[c].a = fgetc( fp );
-			if( VERBOSE )	fprintf( stderr, "%4d:\t0x%02x\t0x%02x\t0x%02x\t0x%02x\n",
-				c, colorTable[c].r, colorTable[c].g, colorTable[c].b, colorTable[c].a );
-		}
-
-		rewind( fp );
-		fseek( fp, FileHeader.bfOffBytes, SEEK_SET );
-		int t;
-		unsigned char *tp;
-		for( t = 0, tp = texture; t < numt; t++ )
-		{
-			for( int s = 0; s < nums; s++, tp += 3 )
-			{
-				int index = fgetc( fp );
-				*(tp+0) = colorTable[index].r;	// r
-				*(tp+1) = colorTable[index].g;	// g
-				*(tp+2) = colorTable[index].b;	// b
-			}
-
-			for( int e = 0; e < numExtra; e++ )
-			{
-				fgetc( fp );
-			}
-		}
-
-		delete[ ] colorTable;
-	}
-
-	fclose( fp );
-
-	*width = nums;
-	*height = numt;
-	return texture;
-}
-
-int
-ReadInt( FILE *fp )
-{
-	const unsigned char b0 = fgetc( fp );
-	const unsigned char b1 = fgetc( fp );
-	const unsigned char b2 = fgetc( fp );
-	const unsigned char b3 = fgetc( fp );
-	return ( b3 << 24 )  |  ( b2 << 16 )  |  ( b1 << 8 )  |  b0;
-}
-
-short
-ReadShort( FILE *fp )
-{
-	const unsigned char b0 = fgetc( fp );
-	const unsigned char b1 = fgetc( fp );
-	return ( b1 << 8 )  |  b0;
-}
-
-
 // function to convert HSV to RGB
 // 0.  <=  s, v, r, g, b  <=  1.
 // 0.  <= h  <=  360.
@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <cerrno>
+
+#include "gltop.hpp"
+#include "memory.hpp"
+#include "util.hpp"
+
+gltop::MemoryAccounting::MemoryAccounting()
+    : mReader(),mPriority(),mCandidates(),mLastRead(0),
+      mLastCost(std::chrono::nanoseconds::zero())
+{
+}
+
+void gltop::MemoryAccounting::sample(std::map<int, Process> &processes,
+                                     std::chrono::nanoseconds budget)
+{
+    auto start = getThreadTime();
+    auto now = std::chrono::steady_clock::now();
+
+    mCandidates.clear();
+    for(auto &[pid, proc] : processes)
+    {
+        if(proc.mMemoryAge >= 0)
+            proc.mMemoryAge++;
+        // Kernel threads have no memory of their own to walk.
+        if(proc.getVMem() == 0 || now < proc.mMemoryRetry)
+            continue;
+        int group = mPriority.count(pid) ? 0 : (proc.mMemoryAge < 0) ? 1 : 2;
+        long growth = static_cast<long>(proc.getRSS())
+            - static_cast<long>(proc.mMemoryRss);
+        mCandidates.push_back({ group, growth, proc.mMemoryAge, &proc });
+    }
+    std::sort(mCandidates.begin(), mCandidates.end(),
+              [](const Candidate &a, const Candidate &b)
+              {
+                  if(a.group != b.group)
+                      return a.group < b.group;
+                  if(a.growth != b.growth)
+                      return a.growth > b.growth;
+                  return a.age > b.age;
+              });
+
+    mLastRead = 0;
+    for(auto &candidate : mCandidates)
+    {
+        // Priority processes are read even when the scan has left no
+        // budget at all.
+        if(candidate.group > 0 && getThreadTime() - start >= budget)
+            break;
+        Process &proc = *candidate.proc;
+        if(mReader.readSmapsRollup(proc.getTID(), proc.mMemory))
+        {
+            proc.mMemoryAge = 0;
+            proc.mMemoryTime = std::chrono::steady_clock::now();
+            proc.mMemoryRss = proc.getRSS();
+            mLastRead++;
+        }
+        else if(errno == EACCES || errno == EPERM)
+        {
+            // Not ours to read; it may be after a setuid or exec, so try
+            // again later. Anything else (it has gone, most likely) is
+            // tried again next time.
+            proc.mMemoryRetry = now + RETRY_INTERVAL;
+        }
+    }
+    mLastCost = getThreadTime() - start;
+}
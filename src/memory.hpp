@@ -0,0 +1,90 @@
+#ifndef GLTOP_MEMORY_HPP
+#define GLTOP_MEMORY_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "procfs.hpp"
+
+namespace gltop
+{
+    class Process;
+
+    // Reads PSS and USS out of smaps_rollup within a CPU time budget per
+    // refresh, since reading it for every process every second costs far
+    // more than the rest of a scan. Processes asked for with setPriority()
+    // are always read, budget or not; then come ones never read, then
+    // those whose RSS grew most since their last read, then the stalest.
+    // The rest keep their old figures, aged so they can be shown as stale.
+    // Processes that are not ours to read are left alone for
+    // RETRY_INTERVAL.
+    class MemoryAccounting
+    {
+    public:
+        static constexpr std::chrono::seconds RETRY_INTERVAL
+            = std::chrono::seconds(30);
+
+        MemoryAccounting();
+
+        ~MemoryAccounting() = default;
+
+        MemoryAccounting(const MemoryAccounting &) = delete;
+        MemoryAccounting &operator=(const MemoryAccounting &) = delete;
+
+        // Read from another procfs root.
+        inline void setProcRoot(const std::string &root)
+        {
+            mReader.open(root);
+        }
+
+        // Read pid ahead of everything else (or stop).
+        inline void setPriority(int pid, bool priority)
+        {
+            if(priority)
+                mPriority.insert(pid);
+            else
+                mPriority.erase(pid);
+        }
+
+        // Read the priority processes, then the rest in order until budget
+        // worth of this thread's CPU time is used, and age what is left.
+        // The budget may be zero or negative.
+        void sample(std::map<int, Process> &processes,
+                    std::chrono::nanoseconds budget);
+
+        // Processes read by the last sample(), and the CPU time it took.
+        inline std::size_t getLastRead() const
+        {
+            return mLastRead;
+        }
+
+        inline std::chrono::nanoseconds getLastCost() const
+        {
+            return mLastCost;
+        }
+
+    private:
+        // A process that could be read, and where it ranks.
+        struct Candidate
+        {
+            // 0 for priority, 1 for never read, 2 for the rest.
+            int group;
+            // RSS growth (kB) since the last read.
+            long growth;
+            int age;
+            Process *proc;
+        };
+
+        ProcReader mReader;
+        std::set<int> mPriority;
+        std::vector<Candidate> mCandidates;
+        std::size_t mLastRead;
+        std::chrono::nanoseconds mLastCost;
+    };
+}
+
+#endif /* GLTOP_MEMORY_HPP */
@@ -0,0 +1,166 @@
+extern "C" {
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <cerrno>
+
+#include "names.hpp"
+
+namespace
+{
+    // Past this, ERANGE is taken as an error rather than grown through.
+    constexpr std::size_t MAX_BUFFER = 1 << 20;
+
+    inline bool operator!=(const timespec &a, const timespec &b)
+    {
+        return a.tv_sec != b.tv_sec || a.tv_nsec != b.tv_nsec;
+    }
+
+    // Call f(data, size, &result), one of the *_r functions, growing buf
+    // from the sysconf hint until it is big enough. Some systems say there
+    // is no such entry with an error rather than a null result.
+    template<typename Entry, typename F>
+    int lookup(std::vector<char> &buf, int hint, F f)
+    {
+        long size = sysconf(hint);
+        buf.resize(std::max<std::size_t>(buf.size(),
+                                         (size > 0) ? size : 1024));
+        for(;;)
+        {
+            Entry *result = nullptr;
+            int error = f(buf.data(), buf.size(), &result);
+            if(error == ERANGE && buf.size() < MAX_BUFFER)
+            {
+                buf.resize(buf.size() * 2);
+                continue;
+            }
+            if((error == 0 && !result) || error == ENOENT || error == ESRCH
+               || error == EBADF || error == EPERM)
+                return ENOENT;
+            return error;
+        }
+    }
+}
+
+int gltop::lookupUser(uid_t uid, passwd &pw, std::vector<char> &buf)
+{
+    return lookup<passwd>(buf, _SC_GETPW_R_SIZE_MAX,
+                          [&](char *data, std::size_t size, passwd **result)
+                          {
+                              return getpwuid_r(uid, &pw, data, size, result);
+                          });
+}
+
+int gltop::lookupUser(const char *name, passwd &pw, std::vector<char> &buf)
+{
+    return lookup<passwd>(buf, _SC_GETPW_R_SIZE_MAX,
+                          [&](char *data, std::size_t size, passwd **result)
+                          {
+                              return getpwnam_r(name, &pw, data, size, result);
+                          });
+}
+
+int gltop::lookupGroup(gid_t gid, group &gr, std::vector<char> &buf)
+{
+    return lookup<group>(buf, _SC_GETGR_R_SIZE_MAX,
+                         [&](char *data, std::size_t size, group **result)
+                         {
+                             return getgrgid_r(gid, &gr, data, size, result);
+                         });
+}
+
+gltop::NameCache &gltop::NameCache::get()
+{
+    static NameCache cache;
+    return cache;
+}
+
+gltop::NameCache::NameCache(const char *passwdPath, const char *groupPath)
+    : mLock(),mBuffer(),mUsers(),mGroups(),mNames(),mIds(),mPasswdPath(passwdPath),
+      mGroupPath(groupPath),mPasswdMtime(getMtime(mPasswdPath)),
+      mGroupMtime(getMtime(mGroupPath)),mGeneration(0)
+{
+}
+
+timespec gltop::NameCache::getMtime(const std::string &path)
+{
+    struct stat st;
+    if(stat(path.c_str(), &st) < 0)
+        return timespec();
+    return st.st_mtim;
+}
+
+gltop::NameCache::Id gltop::NameCache::intern(std::string_view name)
+{
+    auto iter = mIds.find(name);
+    if(iter != mIds.end())
+        return iter->second;
+    auto id = static_cast<Id>(mNames.size());
+    mIds.emplace(mNames.emplace_back(name), id);
+    return id;
+}
+
+gltop::NameCache::Id gltop::NameCache::getUserId(uid_t uid)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    auto iter = mUsers.find(uid);
+    if(iter != mUsers.end())
+        return iter->second;
+
+    passwd pw;
+    int error = lookupUser(uid, pw, mBuffer);
+    if(error == 0)
+        return mUsers.emplace(uid, intern(pw.pw_name)).first->second;
+    Id id = intern(std::to_string(uid));
+    // A failed lookup may work next time; only a missing user is final.
+    if(error == ENOENT)
+        mUsers.emplace(uid, id);
+    return id;
+}
+
+gltop::NameCache::Id gltop::NameCache::getGroupId(gid_t gid)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    auto iter = mGroups.find(gid);
+    if(iter != mGroups.end())
+        return iter->second;
+
+    group gr;
+    int error = lookupGroup(gid, gr, mBuffer);
+    if(error == 0)
+        return mGroups.emplace(gid, intern(gr.gr_name)).first->second;
+    Id id = intern(std::to_string(gid));
+    if(error == ENOENT)
+        mGroups.emplace(gid, id);
+    return id;
+}
+
+const std::string &gltop::NameCache::getName(Id id) const
+{
+    static const std::string unknown;
+    std::lock_guard<std::mutex> lock(mLock);
+    return (id < mNames.size()) ? mNames[id] : unknown;
+}
+
+void gltop::NameCache::revalidate()
+{
+    timespec passwdMtime = getMtime(mPasswdPath);
+    timespec groupMtime = getMtime(mGroupPath);
+    std::lock_guard<std::mutex> lock(mLock);
+    if(passwdMtime != mPasswdMtime || groupMtime != mGroupMtime)
+    {
+        mUsers.clear();
+        mGroups.clear();
+        mPasswdMtime = passwdMtime;
+        mGroupMtime = groupMtime;
+        mGeneration.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+std::size_t gltop::NameCache::size() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mNames.size();
+}
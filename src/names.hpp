@@ -0,0 +1,102 @@
+#ifndef GLTOP_NAMES_HPP
+#define GLTOP_NAMES_HPP
+
+extern "C" {
+#include <grp.h>
+#include <pwd.h>
+#include <sys/types.h>
+#include <time.h>
+}
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace gltop
+{
+    // getpwuid_r, getpwnam_r and getgrgid_r with buf, sized from sysconf
+    // and grown while NSS says it is too small (a group with many members
+    // can need far more than the usual 1024 bytes). 0 if the entry was
+    // found, ENOENT if there is none, or the error that stopped the lookup.
+    int lookupUser(uid_t uid, passwd &pw, std::vector<char> &buf);
+    int lookupUser(const char *name, passwd &pw, std::vector<char> &buf);
+    int lookupGroup(gid_t gid, group &gr, std::vector<char> &buf);
+
+    // Interns user and group names, so each uid and gid goes through NSS
+    // once rather than on every lookup. Processes keep the small ids this
+    // hands out instead of the names. The uid and gid mappings are dropped
+    // when /etc/passwd or /etc/group change; ids already handed out stay
+    // valid. Safe to use from several threads.
+    class NameCache
+    {
+    public:
+        using Id = std::uint32_t;
+        // Not an id.
+        static constexpr Id NONE = ~Id(0);
+
+        // The cache shared by the whole program.
+        static NameCache &get();
+
+        NameCache(const char *passwdPath = "/etc/passwd",
+                  const char *groupPath = "/etc/group");
+
+        ~NameCache() = default;
+
+        NameCache(const NameCache &) = delete;
+        NameCache &operator=(const NameCache &) = delete;
+
+        // Id of the name of user uid (or of the uid in decimal if it has
+        // no name).
+        Id getUserId(uid_t uid);
+
+        // Id of the name of group gid (or of the gid in decimal).
+        Id getGroupId(gid_t gid);
+
+        // The name with the given id. Valid for the life of the cache.
+        const std::string &getName(Id id) const;
+
+        // Drop the uid and gid mappings if /etc/passwd or /etc/group
+        // changed since the last call. Cheap enough to call every refresh.
+        void revalidate();
+
+        // Bumped by every revalidate() that drops the mappings, so ids
+        // resolved before can be told apart.
+        inline std::uint32_t getGeneration() const
+        {
+            return mGeneration.load(std::memory_order_relaxed);
+        }
+
+        // Number of distinct names interned.
+        std::size_t size() const;
+
+    private:
+        // Id of name, adding it if it is new. mLock must be held.
+        Id intern(std::string_view name);
+
+        // Modification time of path (zero if it cannot be stat'd).
+        static timespec getMtime(const std::string &path);
+
+        mutable std::mutex mLock;
+        // For NSS lookups, kept at whatever size they last needed.
+        std::vector<char> mBuffer;
+        std::unordered_map<uid_t, Id> mUsers;
+        std::unordered_map<gid_t, Id> mGroups;
+        // The names, and their ids keyed by views into mNames (a deque, so
+        // the strings never move).
+        std::deque<std::string> mNames;
+        std::unordered_map<std::string_view, Id> mIds;
+        // Files to watch and their mtimes as of the last revalidate().
+        std::string mPasswdPath;
+        std::string mGroupPath;
+        timespec mPasswdMtime;
+        timespec mGroupMtime;
+        std::atomic<std::uint32_t> mGeneration;
+    };
+}
+
+#endif /* GLTOP_NAMES_HPP */
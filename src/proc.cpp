@@ -1,28 +1,529 @@
 
 extern "C" {
 #include <unistd.h>
+#include <pwd.h>
 #include <sys/resource.h>
 #include <sys/types.h>
-#include <proc/procps.h>
-#include <proc/readproc.h>
 }
 
+#include <algorithm>
 #include <cerrno>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 #include <exception>
 #include <vector>
 #include <string>
 #include <chrono>
+#include <iterator>
 
 #include "gltop.hpp"
 
 using namespace std::string_literals;
 
+bool gltop::Process::load(unsigned fields) const
+{
+    fields &= ~mLoaded;
+    if(!fields)
+        return true;
+    if(mNull || !mReader)
+        return false;
+
+    // Re-read stat along with the rest so a pid that has been reused since
+    // the last refresh is not mistaken for this process.
+    // Threads from Proctab have their tgid set up front.
+    ProcInfo info = mProc;
+    bool thread = mProc.tgid && mProc.tgid != mProc.tid;
+    if(!(thread ? mReader->readThread(mProc.tgid, mProc.tid,
+                                      fields | PROC_FIELD_STAT, info)
+         : mReader->read(mProc.tid, fields | PROC_FIELD_STAT, info))
+       || info.startTime != mProc.startTime)
+        return false;
+
+    mProc = info;
+    // The ids have to follow the uid and gid.
+    if(fields & PROC_FIELD_STATUS)
+        mUserId = mGroupId = NameCache::NONE;
+    if(fields & PROC_FIELD_CMDLINE)
+        mCmdline = StringPool::get().intern(mReader->getCmdline());
+    mLoaded |= fields;
+    return true;
+}
+
+void gltop::Process::resolveNames() const
+{
+    auto &cache = NameCache::get();
+    auto generation = cache.getGeneration();
+    // An exec drops the status tier (the uid may have changed with it),
+    // so the ids only stand while it is loaded.
+    if(mUserId != NameCache::NONE && mNameGeneration == generation
+       && (mLoaded & PROC_FIELD_STATUS))
+        return;
+    mUserId = cache.getUserId(getUID());
+    mGroupId = cache.getGroupId(getGID());
+    mNameGeneration = generation;
+}
+
+gltop::ProcFilter::ProcFilter(std::string_view userName,
+                              std::string_view procName)
+    : mUserName(userName),mUid(0),
+      mProcName(procName.substr(0, sizeof(ProcInfo::cmd) - 1))
+{
+    if(!mUserName.empty())
+    {
+        std::vector<char> buf;
+        passwd pw;
+        int error = lookupUser(mUserName.c_str(), pw, buf);
+        if(error == 0)
+            mUid = pw.pw_uid;
+        else if(mUserName.find_first_not_of("0123456789") == std::string::npos)
+            mUid = static_cast<uid_t>(std::stoul(mUserName));
+        else if(error == ENOENT)
+            throw std::runtime_error("Unknown user "s + mUserName);
+        else
+            throw std::runtime_error("Could not look up user "s + mUserName
+                                     + ": " + std::strerror(error));
+    }
+}
+
+bool gltop::ProcFilter::matches(ProcReader &reader, int pid) const
+{
+    uid_t owner = 0;
+    bool kernel;
+    if(!mUserName.empty() && !reader.getOwner(pid, owner))
+        return false;
+    return matches(reader, pid, owner, kernel);
+}
+
+bool gltop::ProcFilter::matches(ProcReader &reader, int pid, uid_t owner,
+                                bool &kernel) const
+{
+    kernel = false;
+    if(!mUserName.empty())
+    {
+        // Non-dumpable processes are owned by root whoever runs them, so
+        // only those need their status read, even when looking for root.
+        if(owner == 0)
+        {
+            ProcInfo info;
+            if(!reader.read(pid, PROC_FIELD_STATUS, info))
+                return false;
+            // kthreadd and its children.
+            kernel = pid == 2 || info.ppid == 2;
+            if(info.uid != mUid)
+                return false;
+        }
+        else if(owner != mUid)
+            return false;
+    }
+    if(!mProcName.empty())
+    {
+        char cmd[sizeof(ProcInfo::cmd)];
+        if(!reader.readComm(pid, cmd) || mProcName != cmd)
+            return false;
+    }
+    return true;
+}
+
+gltop::Proctab::Proctab(std::shared_ptr<ProcReader> reader,
+                        std::string_view userName, std::string_view procName,
+                        bool procsOnly)
+    : mFilter(userName, procName),mProcsOnly(procsOnly),
+      mReader(std::move(reader)),mNext(0),mTasks(),mNextTask(0),mTgid(0),
+      mInfo()
+{
+    mReader->scanPids();
+}
+
 gltop::Process gltop::Proctab::getNextProcess()
 {
-    // TODO search
-    return gltop::Process(mTab.get());
+    // The rest of the last process's threads first.
+    while(mNextTask < mTasks.size())
+    {
+        int tid = mTasks[mNextTask++];
+        if(tid == mTgid)
+            continue;
+        mInfo = ProcInfo();
+        mInfo.tgid = mTgid;
+        if(mReader->readThread(mTgid, tid, PROCOPEN_ARGS, mInfo))
+            return gltop::Process(mInfo, mReader, PROCOPEN_ARGS);
+    }
+
+    const auto &pids = mReader->getPids();
+    while(mNext < pids.size())
+    {
+        int pid = pids[mNext++];
+        mInfo = ProcInfo();
+        if(!mFilter.matches(*mReader, pid)
+           || !mReader->read(pid, PROCOPEN_ARGS, mInfo))
+            continue;
+        mTasks.clear();
+        mNextTask = 0;
+        if(!mProcsOnly && mInfo.numThreads > 1)
+        {
+            mTgid = mInfo.tid;
+            mTasks = mReader->scanTasks(mTgid);
+        }
+        return gltop::Process(mInfo, mReader, PROCOPEN_ARGS);
+    }
+    return gltop::Process();
+}
+
+void gltop::ProcessTable::setThreads(unsigned threads)
+{
+    threads = std::max(threads, 1u);
+    mPool = std::make_unique<WorkerPool>(threads);
+    mWorkerReaders.clear();
+    for(unsigned i = 1; i < threads; i++)
+        mWorkerReaders.push_back(std::make_unique<ProcReader>
+                                 (mReader->getRoot()));
+    mFresh.resize(threads);
+    mThreadScratch.resize(threads);
+}
+
+bool gltop::ProcessTable::matches(ProcReader &reader, int pid,
+                                  Verdict &verdict, bool force) const
+{
+    if(pid == 1 || mFilter.isEmpty())
+        return true;
+    uid_t owner;
+    ino_t ino;
+    if(!reader.getOwner(pid, owner, ino))
+    {
+        verdict = { pid, 0, false, false };
+        return false;
+    }
+    // An exec can change the owner or the name, which only forcing a look
+    // will see; kernel threads do neither.
+    if(verdict.pid == pid && verdict.ino == ino
+       && (!force || verdict.kernel))
+        return verdict.match;
+    verdict.pid = pid;
+    verdict.ino = ino;
+    verdict.match = mFilter.matches(reader, pid, owner, verdict.kernel);
+    return verdict.match;
+}
+
+gltop::ProcessTable::ScanState
+gltop::ProcessTable::scanTask(ProcReader &reader, int pid, Process *proc,
+                              std::vector<ProcInfo> &fresh, bool dropStatus)
+{
+    if(proc)
+    {
+        auto startTime = proc->mProc.startTime;
+        char cmd[sizeof(proc->mProc.cmd)];
+        std::memcpy(cmd, proc->mProc.cmd, sizeof(cmd));
+        if(reader.read(pid, REFRESH_ARGS, proc->mProc)
+           && proc->mProc.startTime == startTime)
+        {
+            // A new comm means an exec, which makes the lazily read tiers
+            // stale.
+            if(std::memcmp(cmd, proc->mProc.cmd, sizeof(cmd)) != 0)
+            {
+                proc->mLoaded = REFRESH_ARGS;
+                proc->mCmdline.reset();
+            }
+            // Nothing else says when the owner changes.
+            else if(dropStatus)
+                proc->mLoaded &= ~static_cast<unsigned>(PROC_FIELD_STATUS);
+            return SCAN_KEPT;
+        }
+        // Exited or pid reused: read it again from scratch.
+    }
+
+    fresh.emplace_back();
+    if(reader.read(pid, REFRESH_ARGS, fresh.back()))
+        return SCAN_NEW;
+    fresh.pop_back();
+    return SCAN_GONE;
+}
+
+void gltop::ProcessTable::refresh(bool walk)
+{
+    NameCache::get().revalidate();
+
+    // Processes that exited are gone from /proc anyway.
+    mExited.clear();
+
+    if(!walk)
+    {
+        mReader->refreshUptime();
+        mPids.clear();
+        for(auto &[pid, proc] : mProcesses)
+            mPids.push_back(pid);
+    }
+    const auto &pids = walk ? mReader->scanPids() : mPids;
+    std::size_t n = pids.size();
+
+    // Pair each pid with its entry in the table, and with the filter's
+    // last verdict on it. All are sorted by pid, so this is a single merge.
+    mMatched.assign(n, nullptr);
+    mStates.assign(n, SCAN_GONE);
+    mNextVerdicts.assign(isFiltered() ? n : 0, Verdict());
+    auto iter = mProcesses.begin();
+    auto verdict = mVerdicts.begin();
+    for(std::size_t i = 0; i < n; i++)
+    {
+        while(iter != mProcesses.end() && iter->first < pids[i])
+            ++iter;
+        if(iter != mProcesses.end() && iter->first == pids[i])
+        {
+            if(!iter->second.isNull())
+                mMatched[i] = &iter->second;
+            ++iter;
+        }
+        if(!isFiltered())
+            continue;
+        while(verdict != mVerdicts.end() && verdict->pid < pids[i])
+            ++verdict;
+        if(verdict != mVerdicts.end() && verdict->pid == pids[i])
+            mNextVerdicts[i] = *verdict;
+    }
+
+    // Read every task, one contiguous shard of pids per worker. Workers only
+    // touch their own shard's processes and their own fresh list, and the
+    // table itself is not modified until they are all done.
+    for(auto &reader : mWorkerReaders)
+        reader->setUptime(mReader->getUptime());
+    for(auto &fresh : mFresh)
+        fresh.clear();
+    mPool->run(n, [&](unsigned worker, std::size_t begin, std::size_t end)
+    {
+        ProcReader &reader = worker ? *mWorkerReaders[worker - 1] : *mReader;
+        for(std::size_t i = begin; i < end; i++)
+        {
+            bool dropStatus = (static_cast<unsigned>(pids[i]) + mRefreshes)
+                % STATUS_REFRESHES == 0;
+            bool match = isFiltered()
+                ? matches(reader, pids[i], mNextVerdicts[i], dropStatus)
+                : true;
+            mStates[i] = match
+                ? scanTask(reader, pids[i], mMatched[i], mFresh[worker],
+                           dropStatus)
+                : SCAN_GONE;
+        }
+    });
+    mRefreshes++;
+    // Only a walk sees the pids the filter turned away; otherwise the
+    // verdicts on them would be lost.
+    if(walk)
+        mVerdicts.swap(mNextVerdicts);
+
+    // Apply births and deaths in pid order. Shards are contiguous, so the
+    // fresh lists taken in worker order are also in pid order.
+    std::size_t worker = 0;
+    std::size_t next = 0;
+    iter = mProcesses.begin();
+    for(std::size_t i = 0; i < n; i++)
+    {
+        while(iter != mProcesses.end() && iter->first < pids[i])
+        {
+            iter = mProcesses.erase(iter);
+            mDeaths++;
+        }
+
+        if(iter != mProcesses.end() && iter->first == pids[i])
+        {
+            if(mStates[i] == SCAN_KEPT)
+            {
+                ++iter;
+                continue;
+            }
+            iter = mProcesses.erase(iter);
+            mDeaths++;
+        }
+
+        if(mStates[i] == SCAN_NEW)
+        {
+            while(next == mFresh[worker].size())
+            {
+                worker++;
+                next = 0;
+            }
+            iter = std::next(mProcesses.emplace_hint
+                             (iter, pids[i],
+                              Process(mFresh[worker][next++], mReader,
+                                      REFRESH_ARGS)));
+            mBirths++;
+        }
+    }
+    while(iter != mProcesses.end())
+    {
+        iter = mProcesses.erase(iter);
+        mDeaths++;
+    }
+
+    mCpuAccounting.sample(mProcesses);
+    refreshThreads();
+}
+
+void gltop::ProcessTable::refreshThreads()
+{
+    mThreaded.clear();
+    for(auto &[pid, proc] : mProcesses)
+    {
+        if(proc.mProc.numThreads > 1
+           && (mThreadMode || mExpanded.count(pid)))
+            mThreaded.push_back(&proc);
+        else
+            proc.mThreads.clear();
+    }
+
+    mPool->run(mThreaded.size(), [&](unsigned worker, std::size_t begin,
+                                     std::size_t end)
+    {
+        ProcReader &reader = worker ? *mWorkerReaders[worker - 1] : *mReader;
+        for(std::size_t i = begin; i < end; i++)
+            readThreads(reader, *mThreaded[i], mThreadScratch[worker]);
+    });
 }
 
+void gltop::ProcessTable::readThreads(ProcReader &reader, Process &proc,
+                                      std::vector<ThreadInfo> &scratch) const
+{
+    int pid = proc.getTID();
+    const auto &old = proc.mThreads;
+    scratch.clear();
+    ProcInfo info;
+    std::size_t j = 0;
+    for(int tid : reader.scanTasks(pid))
+    {
+        if(!reader.readThread(pid, tid, PROC_FIELD_STAT, info))
+            continue;
+        ThreadInfo &thread = scratch.emplace_back();
+        thread.tid = tid;
+        thread.processor = info.processor;
+        thread.ticks = info.utime + info.stime;
+        thread.state = info.state;
+        std::memcpy(thread.cmd, info.cmd, sizeof(thread.cmd));
 
+        // Both lists are in tid order. A thread we have not seen before is
+        // left at 0 until the next read.
+        while(j < old.size() && old[j].tid < tid)
+            j++;
+        if(j < old.size() && old[j].tid == tid && old[j].ticks <= thread.ticks)
+            thread.cpu = mCpuAccounting.ticksToCpu(thread.ticks
+                                                   - old[j].ticks);
+    }
+    proc.mThreads.swap(scratch);
+}
+
+void gltop::ProcessTable::addTask(int pid, int ppid)
+{
+    if(!matches(*mReader, pid))
+        return;
+    ProcInfo info;
+    if(!mReader->read(pid, REFRESH_ARGS, info))
+    {
+        // Already gone. Show it with what it inherited from its parent; a
+        // zero start time makes the next refresh() reload it if the pid is
+        // still around.
+        auto parent = mProcesses.find(ppid);
+        if(parent != mProcesses.end())
+            info = parent->second.mProc;
+        info.tid = pid;
+        info.startTime = 0;
+    }
+    info.ppid = ppid;
+
+    auto iter = mProcesses.find(pid);
+    if(iter != mProcesses.end())
+    {
+        if(info.startTime && iter->second.getStartTime() == info.startTime)
+            return;
+        // The pid was reused before we heard the old process exit.
+        iter->second = Process(info, mReader, REFRESH_ARGS);
+        mDeaths++;
+    }
+    else
+        mProcesses.emplace(pid, Process(info, mReader, REFRESH_ARGS));
+    mBirths++;
+}
+
+bool gltop::ProcessTable::recheck(int pid)
+{
+    auto verdict = std::lower_bound(mVerdicts.begin(), mVerdicts.end(), pid,
+                                    [](const Verdict &v, int pid)
+                                    {
+                                        return v.pid < pid;
+                                    });
+    if(verdict != mVerdicts.end() && verdict->pid == pid)
+        return matches(*mReader, pid, *verdict, true);
+    return matches(*mReader, pid);
+}
+
+void gltop::ProcessTable::applyEvent(const ProcEvent &event)
+{
+    // Only whole processes; thread events have pid != tgid.
+    if(event.pid != event.tgid)
+        return;
+
+    auto iter = mProcesses.find(event.pid);
+    switch(event.type)
+    {
+    case ProcEvent::FORK:
+        addTask(event.pid, event.ppid);
+        break;
+    case ProcEvent::EXEC:
+    {
+        // An exec can change the owner or the name.
+        if(isFiltered() && !recheck(event.pid))
+        {
+            if(iter != mProcesses.end())
+            {
+                mProcesses.erase(iter);
+                mDeaths++;
+            }
+            break;
+        }
+        ProcInfo info;
+        if(!mReader->read(event.pid, REFRESH_ARGS, info))
+            break;
+        if(iter == mProcesses.end())
+        {
+            // Most likely the filter turned it away before the exec.
+            mProcesses.emplace(event.pid,
+                               Process(info, mReader, REFRESH_ARGS));
+            mBirths++;
+            break;
+        }
+        if(iter->second.getStartTime() != info.startTime)
+        {
+            // The event came late and the pid is someone else's now: the
+            // old process died and this one was born, as refresh() has it.
+            iter->second = Process(info, mReader, REFRESH_ARGS);
+            mDeaths++;
+            mBirths++;
+            break;
+        }
+        iter->second.mProc = info;
+        iter->second.mLoaded = REFRESH_ARGS;
+        iter->second.mCmdline.reset();
+        break;
+    }
+    case ProcEvent::COMM:
+        if(iter != mProcesses.end())
+            std::memcpy(iter->second.mProc.cmd, event.comm,
+                        sizeof(event.comm));
+        break;
+    case ProcEvent::EXIT:
+        if(iter != mProcesses.end())
+            mExited.emplace_back(event.pid, iter->second.getStartTime());
+        break;
+    }
+}
+
+void gltop::ProcessTable::flushExited()
+{
+    for(auto [pid, startTime] : mExited)
+    {
+        auto iter = mProcesses.find(pid);
+        if(iter != mProcesses.end()
+           && iter->second.getStartTime() == startTime)
+        {
+            mProcesses.erase(iter);
+            mDeaths++;
+        }
+    }
+    mExited.clear();
+}
@@ -0,0 +1,131 @@
+extern "C" {
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+}
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include "procevents.hpp"
+
+namespace
+{
+    // Tell the kernel to start or stop sending us events.
+    bool sendMcastOp(int fd, proc_cn_mcast_op op)
+    {
+        alignas(nlmsghdr) char buf[NLMSG_SPACE(sizeof(cn_msg)
+                                               + sizeof(proc_cn_mcast_op))];
+        std::memset(buf, 0, sizeof(buf));
+
+        auto hdr = reinterpret_cast<nlmsghdr *>(buf);
+        hdr->nlmsg_len = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(op));
+        hdr->nlmsg_type = NLMSG_DONE;
+        hdr->nlmsg_pid = static_cast<__u32>(getpid());
+
+        auto msg = static_cast<cn_msg *>(NLMSG_DATA(hdr));
+        msg->id.idx = CN_IDX_PROC;
+        msg->id.val = CN_VAL_PROC;
+        msg->len = sizeof(op);
+        std::memcpy(msg->data, &op, sizeof(op));
+
+        return send(fd, hdr, hdr->nlmsg_len, 0) >= 0;
+    }
+}
+
+gltop::ProcEvents::ProcEvents()
+    : mFd(socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                 NETLINK_CONNECTOR)),
+      mBuf()
+{
+    if(mFd < 0)
+    {
+        std::cerr << "Could not open the proc connector: "
+                  << std::strerror(errno) << '\n';
+        return;
+    }
+
+    sockaddr_nl addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    if(bind(mFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0
+       || !sendMcastOp(mFd, PROC_CN_MCAST_LISTEN))
+    {
+        std::cerr << "Could not subscribe to process events: "
+                  << std::strerror(errno) << '\n';
+        close(mFd);
+        mFd = -1;
+    }
+}
+
+gltop::ProcEvents::~ProcEvents()
+{
+    if(mFd >= 0)
+    {
+        sendMcastOp(mFd, PROC_CN_MCAST_IGNORE);
+        close(mFd);
+    }
+}
+
+bool gltop::ProcEvents::read(const callback &fn)
+{
+    if(mFd < 0)
+        return true;
+
+    for(;;)
+    {
+        ssize_t len = recv(mFd, mBuf, sizeof(mBuf), 0);
+        if(len < 0)
+            return errno != ENOBUFS;
+
+        for(auto hdr = reinterpret_cast<nlmsghdr *>(mBuf);
+            NLMSG_OK(hdr, static_cast<unsigned>(len));
+            hdr = NLMSG_NEXT(hdr, len))
+        {
+            if(hdr->nlmsg_type == NLMSG_ERROR
+               || hdr->nlmsg_type == NLMSG_NOOP)
+                continue;
+
+            auto msg = static_cast<const cn_msg *>(NLMSG_DATA(hdr));
+            if(msg->id.idx != CN_IDX_PROC || msg->id.val != CN_VAL_PROC)
+                continue;
+            auto ev = reinterpret_cast<const proc_event *>(msg->data);
+
+            ProcEvent event;
+            switch(ev->what)
+            {
+            case proc_event::PROC_EVENT_FORK:
+                event.type = ProcEvent::FORK;
+                event.pid = ev->event_data.fork.child_pid;
+                event.tgid = ev->event_data.fork.child_tgid;
+                event.ppid = ev->event_data.fork.parent_tgid;
+                break;
+            case proc_event::PROC_EVENT_EXEC:
+                event.type = ProcEvent::EXEC;
+                event.pid = ev->event_data.exec.process_pid;
+                event.tgid = ev->event_data.exec.process_tgid;
+                break;
+            case proc_event::PROC_EVENT_COMM:
+                event.type = ProcEvent::COMM;
+                event.pid = ev->event_data.comm.process_pid;
+                event.tgid = ev->event_data.comm.process_tgid;
+                std::memcpy(event.comm, ev->event_data.comm.comm,
+                            sizeof(event.comm));
+                event.comm[sizeof(event.comm) - 1] = '\0';
+                break;
+            case proc_event::PROC_EVENT_EXIT:
+                event.type = ProcEvent::EXIT;
+                event.pid = ev->event_data.exit.process_pid;
+                event.tgid = ev->event_data.exit.process_tgid;
+                break;
+            default:
+                continue;
+            }
+            fn(event);
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef GLTOP_PROCEVENTS_HPP
+#define GLTOP_PROCEVENTS_HPP
+
+#include <cstddef>
+#include <functional>
+
+namespace gltop
+{
+    // A process lifecycle event from the kernel's proc connector.
+    struct ProcEvent
+    {
+        enum Type
+        {
+            FORK, // pid was forked by ppid.
+            EXEC, // pid called exec.
+            COMM, // pid changed its comm to comm.
+            EXIT, // pid exited.
+        };
+
+        Type type = FORK;
+        int pid = 0;       // Task the event is about.
+        int tgid = 0;      // Its thread group.
+        int ppid = 0;      // Parent's tgid (FORK only).
+        char comm[16] = {}; // New comm (COMM only).
+    };
+
+    // Subscription to fork/exec/comm/exit events through the netlink proc
+    // connector. Needs CAP_NET_ADMIN; if the socket cannot be set up,
+    // isOpen() is false and the caller should stick to polling /proc.
+    class ProcEvents
+    {
+    public:
+        using callback = std::function<void(const ProcEvent &)>;
+
+        // Try to subscribe. Never throws.
+        ProcEvents();
+
+        ~ProcEvents();
+
+        ProcEvents(const ProcEvents &) = delete;
+        ProcEvents &operator=(const ProcEvents &) = delete;
+
+        inline bool isOpen() const
+        {
+            return mFd >= 0;
+        }
+
+        // Socket to poll() for readability.
+        inline int getFd() const
+        {
+            return mFd;
+        }
+
+        // Call fn for every pending event, without blocking. Returns false
+        // if the kernel dropped events (the socket buffer overflowed), in
+        // which case the caller should rescan.
+        bool read(const callback &fn);
+
+    private:
+        int mFd;
+        // Receive buffer.
+        alignas(8) char mBuf[8192];
+    };
+}
+
+#endif /* GLTOP_PROCEVENTS_HPP */
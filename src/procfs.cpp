@@ -0,0 +1,515 @@
+extern "C" {
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+}
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include "procfs.hpp"
+
+using namespace std::string_literals;
+
+namespace
+{
+    // Layout of the records returned by getdents64(2).
+    struct linuxDirent64
+    {
+        std::uint64_t d_ino;
+        std::int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+
+    // Skip spaces and tabs.
+    inline const char *skipSpace(const char *p, const char *end)
+    {
+        while(p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        return p;
+    }
+
+    // Skip n space separated fields.
+    inline const char *skipFields(const char *p, const char *end, int n)
+    {
+        for(; n > 0; n--)
+        {
+            p = skipSpace(p, end);
+            while(p < end && *p != ' ' && *p != '\t' && *p != '\n')
+                p++;
+        }
+        return p;
+    }
+
+    // Parse an unsigned decimal, leaving p after it.
+    inline unsigned long long parseULL(const char *&p, const char *end)
+    {
+        p = skipSpace(p, end);
+        unsigned long long result = 0;
+        for(; p < end && *p >= '0' && *p <= '9'; p++)
+            result = result * 10 + static_cast<unsigned long long>(*p - '0');
+        return result;
+    }
+
+    // Parse a signed decimal, leaving p after it.
+    inline long long parseLL(const char *&p, const char *end)
+    {
+        p = skipSpace(p, end);
+        bool negative = (p < end && *p == '-');
+        if(negative)
+            p++;
+        auto result = static_cast<long long>(parseULL(p, end));
+        return negative ? -result : result;
+    }
+
+    // True if name is all digits.
+    inline bool isPidName(const char *name)
+    {
+        if(!*name)
+            return false;
+        for(; *name; name++)
+            if(*name < '0' || *name > '9')
+                return false;
+        return true;
+    }
+
+    // Parse /proc/<pid>/stat.
+    bool parseStat(const char *buf, std::size_t len, unsigned long pageKB,
+                   gltop::ProcInfo &info)
+    {
+        const char *end = buf + len;
+        const char *p = buf;
+        info.tid = static_cast<int>(parseULL(p, end));
+
+        // The comm field may itself contain spaces and parentheses, so it
+        // runs from the first '(' to the last ')'.
+        auto open = static_cast<const char *>(std::memchr(p, '(', end - p));
+        auto close = static_cast<const char *>(memrchr(p, ')', end - p));
+        if(!open || !close || close < open)
+            return false;
+        std::size_t commLen = std::min<std::size_t>(close - open - 1,
+                                                    sizeof(info.cmd) - 1);
+        std::memcpy(info.cmd, open + 1, commLen);
+        info.cmd[commLen] = '\0';
+
+        p = skipSpace(close + 1, end);
+        if(p >= end)
+            return false;
+        info.state = *p++;                                 // 3
+        info.ppid = static_cast<int>(parseLL(p, end));     // 4
+        info.pgrp = static_cast<int>(parseLL(p, end));     // 5
+        p = skipFields(p, end, 8);                         // 6-13
+        info.utime = parseULL(p, end);                     // 14
+        info.stime = parseULL(p, end);                     // 15
+        p = skipFields(p, end, 3);                         // 16-18
+        info.nice = static_cast<long>(parseLL(p, end));    // 19
+        info.numThreads = static_cast<long>(parseLL(p, end)); // 20
+        p = skipFields(p, end, 1);                         // 21
+        info.startTime = parseULL(p, end);                 // 22
+        info.vmSize = static_cast<unsigned long>(parseULL(p, end) / 1024); // 23
+        info.vmRSS = static_cast<unsigned long>(parseULL(p, end)) * pageKB; // 24
+        p = skipFields(p, end, 14);                        // 25-38
+        info.processor = static_cast<int>(parseLL(p, end)); // 39
+        return true;
+    }
+
+    // Parse /proc/<pid>/statm.
+    void parseStatm(const char *buf, std::size_t len, unsigned long pageKB,
+                    gltop::ProcInfo &info)
+    {
+        const char *end = buf + len;
+        const char *p = buf;
+        info.vmSize = static_cast<unsigned long>(parseULL(p, end)) * pageKB;
+        info.vmRSS = static_cast<unsigned long>(parseULL(p, end)) * pageKB;
+    }
+
+    // Parse the fields we care about out of /proc/<pid>/status.
+    void parseStatus(const char *buf, std::size_t len, gltop::ProcInfo &info)
+    {
+        const char *end = buf + len;
+        for(const char *line = buf; line < end;)
+        {
+            auto eol = static_cast<const char *>(std::memchr(line, '\n',
+                                                             end - line));
+            if(!eol)
+                eol = end;
+            const char *p = line;
+            auto lineLen = static_cast<std::size_t>(eol - line);
+            // Each line is "Key:\tvalue". Uid and Gid are
+            // "real effective saved fs".
+            if(lineLen > 5 && std::memcmp(line, "Tgid:", 5) == 0)
+            {
+                p += 5;
+                info.tgid = static_cast<int>(parseULL(p, eol));
+            }
+            else if(lineLen > 5 && std::memcmp(line, "PPid:", 5) == 0)
+            {
+                p += 5;
+                info.ppid = static_cast<int>(parseULL(p, eol));
+            }
+            else if(lineLen > 4 && std::memcmp(line, "Uid:", 4) == 0)
+            {
+                p += 4;
+                parseULL(p, eol);
+                info.uid = static_cast<uid_t>(parseULL(p, eol));
+            }
+            else if(lineLen > 4 && std::memcmp(line, "Gid:", 4) == 0)
+            {
+                p += 4;
+                parseULL(p, eol);
+                info.gid = static_cast<gid_t>(parseULL(p, eol));
+                // Nothing we want comes after Gid.
+                break;
+            }
+            line = eol + 1;
+        }
+    }
+
+    // Parse the totals out of /proc/<pid>/smaps_rollup. Each line is
+    // "Key:   value kB".
+    void parseSmapsRollup(const char *buf, std::size_t len,
+                          gltop::MemoryDetail &detail)
+    {
+        const char *end = buf + len;
+        detail = gltop::MemoryDetail();
+        for(const char *line = buf; line < end;)
+        {
+            auto eol = static_cast<const char *>(std::memchr(line, '\n',
+                                                             end - line));
+            if(!eol)
+                eol = end;
+            const char *p = line;
+            auto lineLen = static_cast<std::size_t>(eol - line);
+            if(lineLen > 4 && std::memcmp(line, "Pss:", 4) == 0)
+            {
+                p += 4;
+                detail.pss = static_cast<unsigned long>(parseULL(p, eol));
+            }
+            else if(lineLen > 14
+                    && std::memcmp(line, "Private_Clean:", 14) == 0)
+            {
+                p += 14;
+                detail.uss += static_cast<unsigned long>(parseULL(p, eol));
+            }
+            else if(lineLen > 14
+                    && std::memcmp(line, "Private_Dirty:", 14) == 0)
+            {
+                p += 14;
+                detail.uss += static_cast<unsigned long>(parseULL(p, eol));
+            }
+            else if(lineLen > 8 && std::memcmp(line, "SwapPss:", 8) == 0)
+            {
+                p += 8;
+                detail.swapPss = static_cast<unsigned long>(parseULL(p, eol));
+            }
+            line = eol + 1;
+        }
+    }
+
+    // Parse the counters we care about out of /proc/<pid>/io. Each line is
+    // "key: value".
+    void parseIo(const char *buf, std::size_t len, gltop::IoCounters &io)
+    {
+        const char *end = buf + len;
+        for(const char *line = buf; line < end;)
+        {
+            auto eol = static_cast<const char *>(std::memchr(line, '\n',
+                                                             end - line));
+            if(!eol)
+                eol = end;
+            auto colon = static_cast<const char *>(std::memchr(line, ':',
+                                                               eol - line));
+            if(colon)
+            {
+                const char *p = colon + 1;
+                std::string_view key(line, colon - line);
+                if(key == "syscr")
+                    io.syscr = parseULL(p, eol);
+                else if(key == "syscw")
+                    io.syscw = parseULL(p, eol);
+                else if(key == "read_bytes")
+                    io.readBytes = parseULL(p, eol);
+                else if(key == "write_bytes")
+                    io.writeBytes = parseULL(p, eol);
+            }
+            line = eol + 1;
+        }
+    }
+}
+
+gltop::ProcReader::ProcReader(const std::string &root)
+    : mRoot(),mRootFd(-1),mTicksPerSec(sysconf(_SC_CLK_TCK)),
+      mPageKB(static_cast<unsigned long>(sysconf(_SC_PAGESIZE)) / 1024),
+      mUptime(0.),mPids(),mTasks(),mDents(32768),mCmdline(4096),
+      mCmdlineLen(0),mStatBuf(),mStatmBuf(),mStatusBuf(),mPath()
+{
+    open(root);
+    if(mTicksPerSec <= 0)
+        mTicksPerSec = 100;
+}
+
+gltop::ProcReader::~ProcReader()
+{
+    close(mRootFd);
+}
+
+void gltop::ProcReader::open(const std::string &root)
+{
+    int fd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0)
+        throw std::runtime_error("Could not open "s + root + ": "
+                                 + std::strerror(errno));
+    if(mRootFd >= 0)
+        close(mRootFd);
+    mRootFd = fd;
+    mRoot = root;
+}
+
+void gltop::ProcReader::refreshUptime()
+{
+    char uptime[64];
+    int fd = openat(mRootFd, "uptime", O_RDONLY | O_CLOEXEC);
+    if(fd >= 0)
+    {
+        ssize_t len = pread(fd, uptime, sizeof(uptime) - 1, 0);
+        close(fd);
+        if(len > 0)
+        {
+            const char *p = uptime;
+            const char *end = uptime + len;
+            auto seconds = parseULL(p, end);
+            unsigned long long hundredths = 0;
+            if(p < end && *p == '.')
+                hundredths = parseULL(++p, end);
+            mUptime = static_cast<double>(seconds)
+                + static_cast<double>(hundredths) / 100.;
+        }
+    }
+}
+
+void gltop::ProcReader::readPidDir(int fd, std::vector<int> &list)
+{
+    list.clear();
+    for(;;)
+    {
+        auto n = syscall(SYS_getdents64, fd, mDents.data(), mDents.size());
+        if(n <= 0)
+            break;
+        for(long off = 0; off < n;)
+        {
+            auto dent = reinterpret_cast<const linuxDirent64 *>
+                (mDents.data() + off);
+            if(isPidName(dent->d_name))
+                list.push_back(std::atoi(dent->d_name));
+            off += dent->d_reclen;
+        }
+    }
+    std::sort(list.begin(), list.end());
+}
+
+const std::vector<int> &gltop::ProcReader::scanPids()
+{
+    refreshUptime();
+    if(lseek(mRootFd, 0, SEEK_SET) < 0)
+    {
+        mPids.clear();
+        return mPids;
+    }
+    readPidDir(mRootFd, mPids);
+    return mPids;
+}
+
+const std::vector<int> &gltop::ProcReader::scanTasks(int pid)
+{
+    std::snprintf(mPath, sizeof(mPath), "%d/task", pid);
+    int fd = openat(mRootFd, mPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        mTasks.clear();
+        return mTasks;
+    }
+    readPidDir(fd, mTasks);
+    close(fd);
+    return mTasks;
+}
+
+ssize_t gltop::ProcReader::readFile(int pid, int tid, const char *name,
+                                    char *buf, std::size_t size)
+{
+    if(tid)
+        std::snprintf(mPath, sizeof(mPath), "%d/task/%d/%s", pid, tid, name);
+    else
+        std::snprintf(mPath, sizeof(mPath), "%d/%s", pid, name);
+    int fd = openat(mRootFd, mPath, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return -1;
+    ssize_t len = pread(fd, buf, size - 1, 0);
+    close(fd);
+    if(len < 0)
+        return -1;
+    buf[len] = '\0';
+    return len;
+}
+
+bool gltop::ProcReader::getOwner(int pid, uid_t &uid)
+{
+    ino_t ino;
+    return getOwner(pid, uid, ino);
+}
+
+bool gltop::ProcReader::getOwner(int pid, uid_t &uid, ino_t &ino)
+{
+    std::snprintf(mPath, sizeof(mPath), "%d", pid);
+    struct stat st;
+    if(fstatat(mRootFd, mPath, &st, 0) < 0)
+        return false;
+    uid = st.st_uid;
+    ino = st.st_ino;
+    return true;
+}
+
+bool gltop::ProcReader::readComm(int pid, char (&cmd)[16])
+{
+    char buf[32];
+    ssize_t len = readFile(pid, 0, "comm", buf, sizeof(buf));
+    if(len <= 0)
+        return false;
+    // Drop the newline.
+    if(buf[len - 1] == '\n')
+        len--;
+    std::size_t n = std::min<std::size_t>(static_cast<std::size_t>(len),
+                                          sizeof(cmd) - 1);
+    std::memcpy(cmd, buf, n);
+    cmd[n] = '\0';
+    return true;
+}
+
+bool gltop::ProcReader::readSmapsRollup(int pid, MemoryDetail &detail)
+{
+    // Not read while a task's status is being parsed, so borrow its
+    // buffer.
+    ssize_t len = readFile(pid, 0, "smaps_rollup", mStatusBuf,
+                           sizeof(mStatusBuf));
+    if(len == 0)
+        errno = ENODATA;
+    if(len <= 0)
+        return false;
+    parseSmapsRollup(mStatusBuf, static_cast<std::size_t>(len), detail);
+    return true;
+}
+
+bool gltop::ProcReader::readIo(int pid, IoCounters &io)
+{
+    char buf[512];
+    ssize_t len = readFile(pid, 0, "io", buf, sizeof(buf));
+    if(len < 0)
+        return false;
+    parseIo(buf, static_cast<std::size_t>(len), io);
+    return true;
+}
+
+bool gltop::ProcReader::readCgroup(int pid, std::string &path)
+{
+    // Only called when a process is first seen, so borrow the status
+    // buffer.
+    ssize_t len = readFile(pid, 0, "cgroup", mStatusBuf, sizeof(mStatusBuf));
+    if(len <= 0)
+        return false;
+    const char *end = mStatusBuf + len;
+    for(const char *line = mStatusBuf; line < end;)
+    {
+        auto eol = static_cast<const char *>(std::memchr(line, '\n',
+                                                         end - line));
+        if(!eol)
+            eol = end;
+        if(eol - line >= 3 && std::memcmp(line, "0::", 3) == 0)
+        {
+            path.assign(line + 3, eol);
+            return true;
+        }
+        line = eol + 1;
+    }
+    return false;
+}
+
+bool gltop::ProcReader::readCmdline(int pid)
+{
+    mCmdlineLen = 0;
+    std::snprintf(mPath, sizeof(mPath), "%d/cmdline", pid);
+    int fd = openat(mRootFd, mPath, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    for(;;)
+    {
+        if(mCmdlineLen == mCmdline.size())
+            mCmdline.resize(mCmdline.size() * 2);
+        ssize_t len = pread(fd, mCmdline.data() + mCmdlineLen,
+                            mCmdline.size() - mCmdlineLen,
+                            static_cast<off_t>(mCmdlineLen));
+        if(len <= 0)
+            break;
+        mCmdlineLen += static_cast<std::size_t>(len);
+    }
+    close(fd);
+    // Drop the trailing NUL so splitting on NUL gives no empty last arg.
+    if(mCmdlineLen && mCmdline[mCmdlineLen - 1] == '\0')
+        mCmdlineLen--;
+    return true;
+}
+
+bool gltop::ProcReader::readTask(int pid, int tid, unsigned fields,
+                                 ProcInfo &info)
+{
+    info.tid = tid ? tid : pid;
+
+    if(fields & PROC_FIELD_STAT)
+    {
+        ssize_t len = readFile(pid, tid, "stat", mStatBuf,
+                               sizeof(mStatBuf));
+        if(len <= 0 || !parseStat(mStatBuf, static_cast<std::size_t>(len),
+                                  mPageKB, info))
+            return false;
+
+        // Lifetime average, the same way ps computes it.
+        double seconds = mUptime - static_cast<double>(info.startTime)
+            / static_cast<double>(mTicksPerSec);
+        if(seconds > 0.)
+            info.pcpu = static_cast<int>
+                (static_cast<double>(info.utime + info.stime)
+                 / static_cast<double>(mTicksPerSec) * 100. / seconds);
+    }
+
+    if(fields & PROC_FIELD_STATM)
+    {
+        ssize_t len = readFile(pid, tid, "statm", mStatmBuf,
+                               sizeof(mStatmBuf));
+        if(len <= 0)
+            return false;
+        parseStatm(mStatmBuf, static_cast<std::size_t>(len), mPageKB, info);
+    }
+
+    if(fields & PROC_FIELD_STATUS)
+    {
+        ssize_t len = readFile(pid, tid, "status", mStatusBuf,
+                               sizeof(mStatusBuf));
+        if(len <= 0)
+            return false;
+        parseStatus(mStatusBuf, static_cast<std::size_t>(len), info);
+    }
+
+    if(fields & PROC_FIELD_CMDLINE)
+        readCmdline(pid);
+    else
+        mCmdlineLen = 0;
+
+    return true;
+}
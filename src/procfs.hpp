@@ -0,0 +1,214 @@
+#ifndef GLTOP_PROCFS_HPP
+#define GLTOP_PROCFS_HPP
+
+extern "C" {
+#include <sys/types.h>
+}
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gltop
+{
+    // Files to read for each task (see ProcReader::read()).
+    enum ProcFields : unsigned
+    {
+        PROC_FIELD_STAT    = 1u << 0, // /proc/<pid>/stat
+        PROC_FIELD_STATM   = 1u << 1, // /proc/<pid>/statm
+        PROC_FIELD_STATUS  = 1u << 2, // /proc/<pid>/status
+        PROC_FIELD_CMDLINE = 1u << 3, // /proc/<pid>/cmdline
+    };
+
+    // One task as parsed out of procfs. Plain data, so it can be reused
+    // between reads without touching the heap.
+    struct ProcInfo
+    {
+        int tid = 0;                      // Task id.
+        int tgid = 0;                     // Thread group id (status).
+        int ppid = 0;                     // Parent's pid.
+        int pgrp = 0;                     // Process group id.
+        int processor = 0;                // Last CPU the task ran on.
+        char state = '\0';                // R, S, D, Z...
+        long nice = 0;                    // Nice value.
+        long numThreads = 0;              // Number of threads.
+        unsigned long long utime = 0;     // User time (clock ticks).
+        unsigned long long stime = 0;     // System time (clock ticks).
+        unsigned long long startTime = 0; // Start time (ticks since boot).
+        unsigned long vmSize = 0;         // Virtual memory size (kB).
+        unsigned long vmRSS = 0;          // Resident set size (kB).
+        uid_t uid = 0;                    // Effective user id (status).
+        gid_t gid = 0;                    // Effective group id (status).
+        int pcpu = 0;                     // Lifetime average %CPU.
+        char cmd[16] = {};                // Basename (comm), NUL terminated.
+    };
+
+    // What a process really uses (kB), from /proc/<pid>/smaps_rollup.
+    // Walking the page tables for these is costly, so they are read on a
+    // budget rather than every refresh.
+    struct MemoryDetail
+    {
+        unsigned long pss = 0;     // Proportional set size.
+        unsigned long uss = 0;     // Private_Clean + Private_Dirty.
+        unsigned long swapPss = 0; // Proportional share of swap.
+    };
+
+    // Lifetime I/O counters of a process, from /proc/<pid>/io.
+    struct IoCounters
+    {
+        unsigned long long readBytes = 0;  // Fetched from storage.
+        unsigned long long writeBytes = 0; // Sent towards storage.
+        unsigned long long syscr = 0;      // read()-like calls.
+        unsigned long long syscw = 0;      // write()-like calls.
+    };
+
+    // Reads tasks straight out of /proc. All reads go through openat()
+    // relative to a directory fd held open on /proc and pread() into buffers
+    // owned by the reader, so once warmed up a scan does not allocate. The
+    // root can be any directory laid out like /proc, such as a synthetic
+    // tree from gltop_procgen.
+    class ProcReader
+    {
+    public:
+        static constexpr char DEFAULT_ROOT[] = "/proc";
+
+        ProcReader(const std::string &root = DEFAULT_ROOT);
+
+        ~ProcReader();
+
+        ProcReader(const ProcReader &) = delete;
+        ProcReader &operator=(const ProcReader &) = delete;
+
+        // Read from another root from now on.
+        void open(const std::string &root);
+
+        inline const std::string &getRoot() const
+        {
+            return mRoot;
+        }
+
+        // List the numeric directories in /proc, sorted. Also refreshes the
+        // system uptime used for pcpu. The returned list is valid until the
+        // next call.
+        const std::vector<int> &scanPids();
+
+        // Re-read the system uptime (scanPids() does this itself).
+        void refreshUptime();
+
+        // Seconds since boot as of the last scanPids(), used for pcpu.
+        inline double getUptime() const
+        {
+            return mUptime;
+        }
+
+        // Use another reader's uptime (for readers that never scan).
+        inline void setUptime(double uptime)
+        {
+            mUptime = uptime;
+        }
+
+        // Pids found by the last scanPids().
+        inline const std::vector<int> &getPids() const
+        {
+            return mPids;
+        }
+
+        // List the tasks (threads, leader included) of process pid, sorted.
+        // The returned list is valid until the next call. Empty if the
+        // process has gone.
+        const std::vector<int> &scanTasks(int pid);
+
+        // Read the files selected by fields (a ProcFields mask) for pid into
+        // info. Fields that come from other files are left alone, so a known
+        // task can be refreshed in place from stat alone (stat also carries
+        // vsize and rss). Returns false if the task vanished or could not be
+        // read.
+        inline bool read(int pid, unsigned fields, ProcInfo &info)
+        {
+            return readTask(pid, 0, fields, info);
+        }
+
+        // The same for thread tid of process pid, from
+        // /proc/<pid>/task/<tid>. Times and state are the thread's own.
+        inline bool readThread(int pid, int tid, unsigned fields,
+                               ProcInfo &info)
+        {
+            return readTask(pid, tid, fields, info);
+        }
+
+        // Effective uid of pid, from the owner of /proc/<pid>, so without
+        // reading anything. Processes that are not dumpable (setuid
+        // programs and the like) show up as root.
+        bool getOwner(int pid, uid_t &uid);
+
+        // As above, along with the inode of /proc/<pid>, which a new
+        // process reusing the pid does not share.
+        bool getOwner(int pid, uid_t &uid, ino_t &ino);
+
+        // Read the comm of pid (as in stat) into cmd, NUL terminated.
+        bool readComm(int pid, char (&cmd)[16]);
+
+        // Read the smaps_rollup totals of pid. False if the process has
+        // gone, has no memory (kernel threads) or is not ours to read; in
+        // the last case errno is EACCES or EPERM.
+        bool readSmapsRollup(int pid, MemoryDetail &detail);
+
+        // Read the I/O counters of pid. On failure errno says why: EACCES
+        // for processes that are not ours to look at.
+        bool readIo(int pid, IoCounters &io);
+
+        // The cgroup v2 path of pid (as "/system.slice/foo.service"), from
+        // the "0::" line of /proc/<pid>/cgroup. False if the process has
+        // gone or is not in a v2 hierarchy.
+        bool readCgroup(int pid, std::string &path);
+
+        // NUL separated command line of the last task read with
+        // PROC_FIELD_CMDLINE. Valid until the next read().
+        inline std::string_view getCmdline() const
+        {
+            return std::string_view(mCmdline.data(), mCmdlineLen);
+        }
+
+    private:
+        // read() and readThread(); tid 0 means the process itself.
+        bool readTask(int pid, int tid, unsigned fields, ProcInfo &info);
+
+        // Read /proc/<pid>/<name> (or /proc/<pid>/task/<tid>/<name>) into
+        // buf, NUL terminate it and return the number of bytes read, or -1
+        // on error.
+        ssize_t readFile(int pid, int tid, const char *name, char *buf,
+                         std::size_t size);
+
+        // List the numeric entries of directory fd into list, sorted.
+        void readPidDir(int fd, std::vector<int> &list);
+
+        // Read /proc/<pid>/cmdline into mCmdline, growing it as needed.
+        bool readCmdline(int pid);
+
+        // The root, and a directory fd open on it.
+        std::string mRoot;
+        int mRootFd;
+        // Clock ticks per second.
+        long mTicksPerSec;
+        // Page size in kB.
+        unsigned long mPageKB;
+        // Seconds since boot at the last scanPids().
+        double mUptime;
+        // Pids found by the last scan, and tasks by the last scanTasks().
+        std::vector<int> mPids;
+        std::vector<int> mTasks;
+        // getdents64() buffer.
+        std::vector<char> mDents;
+        // Command line of the last task read.
+        std::vector<char> mCmdline;
+        std::size_t mCmdlineLen;
+        // Per-file read buffers.
+        char mStatBuf[1024];
+        char mStatmBuf[256];
+        char mStatusBuf[4096];
+        char mPath[64];
+    };
+}
+
+#endif /* GLTOP_PROCFS_HPP */
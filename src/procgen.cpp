@@ -0,0 +1,745 @@
+// Writes a synthetic procfs for scale testing: a directory laid out like
+// /proc, with stat, statm, status, cmdline, comm, io, smaps_rollup, cgroup
+// and task/ for each of n processes, plus the system files the collector
+// reads. Point gltop at it with --proc-root.
+//
+// Usage: gltop_procgen dir n [--seed s] [--churn rate] [--ticks k]
+//                            [--tick-ms ms] [--cgroup-root cgdir]
+//
+// Processes are placed in cgroups the way systemd does it: each service
+// under init gets its own, in system.slice or a user's session, and
+// children stay in their parent's. With --cgroup-root, the matching
+// cgroup2 tree is written to cgdir too, with cpu.stat, memory.current and
+// pids.current totals for every group; point gltop at it with the same
+// flag.
+//
+// The same seed always gives the same tree. With --churn, every tick
+// replaces rate (a fraction) of the processes, new ones forking off
+// existing ones, and charges CPU time to a fifth of the rest; files are
+// replaced by rename so a reader never sees half of one. The system files
+// are rewritten in place instead, as gltop keeps them open, and the
+// system's CPU load swings from tick to tick. The cgroup totals are
+// rewritten in place as well.
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace chron = std::chrono;
+
+namespace
+{
+    constexpr int PID_MAX = 4194304;
+    constexpr unsigned long PAGE_KB = 4;
+    constexpr unsigned long long TICKS_PER_SEC = 100;
+    // How long the synthetic machine has been up when generated.
+    constexpr unsigned long long BOOT_UPTIME = 86400 * TICKS_PER_SEC;
+
+    const char *const USER_NAMES[] =
+    {
+        "bash", "sshd", "nginx", "postgres", "python3", "java", "node",
+        "containerd-shim", "dockerd", "sleep", "cron", "rsyslogd", "make",
+        "cc1plus", "chrome", "redis-server", "systemd", "dbus-daemon",
+        "sh", "vim", "tmux", "php-fpm", "gunicorn", "ruby", "perl",
+    };
+    const char *const KERNEL_NAMES[] =
+    {
+        "kworker/%d:1", "ksoftirqd/%d", "migration/%d", "rcu_gp",
+        "kworker/u%d:2", "irq/%d-nvme", "jbd2/sda%d-8", "kswapd%d",
+    };
+    const unsigned USER_IDS[] = { 0, 0, 1000, 1001, 33, 999 };
+
+    struct Process
+    {
+        int pid = 0;
+        int ppid = 0;
+        std::string name;
+        bool kernel = false;
+        bool alive = false;
+        int children = 0;
+        unsigned uid = 0;
+        // Other threads' tids; the leader's is pid.
+        std::vector<int> threads;
+        unsigned long long utime = 0;
+        unsigned long long stime = 0;
+        unsigned long long startTime = 0;
+        unsigned long rssPages = 0;
+        unsigned long long readBytes = 0;
+        unsigned long long writeBytes = 0;
+        // Index of its cgroup in the generator's list; 0 is the root.
+        int cgroup = 0;
+    };
+
+    // A cgroup. Groups are never removed, so a parent always comes before
+    // its children in the list.
+    struct Cgroup
+    {
+        std::string path;
+        int parent = -1;
+        // CPU time of the processes that died in it, in ticks.
+        unsigned long long deadTicks = 0;
+    };
+
+    class Generator
+    {
+    public:
+        Generator(const std::string &root, const std::string &cgroupRoot,
+                  unsigned seed)
+            : mRoot(root),mCgroupRoot(cgroupRoot),mRng(seed),mProcesses(),
+              mSlots(PID_MAX, -1),mUrn(),mCgroups(),mUserSlices(),
+              mSessions(0),mLive(0),mNextPid(1),mUptime(BOOT_UPTIME),
+              mCpuBusy(BOOT_UPTIME / 4),mCpuIdle(BOOT_UPTIME - mCpuBusy),
+              mBuf()
+        {
+        }
+
+        // Write the system files and n processes.
+        void generate(int n)
+        {
+            makeDir(mRoot);
+            makeDir(mRoot + "/sys");
+            makeDir(mRoot + "/sys/kernel");
+            writeFile(mRoot + "/sys/kernel/pid_max",
+                      std::to_string(PID_MAX) + "\n", false);
+
+            if(!mCgroupRoot.empty())
+                makeDir(mCgroupRoot);
+            addCgroup(-1, "");
+            addCgroup(0, "init.scope");
+            addCgroup(0, "system.slice");
+            addCgroup(0, "user.slice");
+
+            // init, kthreadd and a tenth of the rest kernel threads,
+            // started in the first few seconds of boot.
+            int kernel = std::max(1, n / 10);
+            spawn(0, "systemd", false, 1);
+            if(n > 1)
+                spawn(0, "kthreadd", true, 1);
+            for(int i = 0; i < kernel && mLive < n; i++)
+            {
+                char name[32];
+                std::snprintf(name, sizeof(name),
+                              KERNEL_NAMES[i % std::size(KERNEL_NAMES)],
+                              i / static_cast<int>(std::size(KERNEL_NAMES)));
+                spawn(2, name, true, 2 + i % 300);
+            }
+            while(mLive < n)
+            {
+                auto start = BOOT_UPTIME * static_cast<unsigned long long>
+                    (mLive) / static_cast<unsigned long long>(n);
+                spawn(pickParent(), nullptr, false, start);
+            }
+
+            for(auto &proc : mProcesses)
+                writeProcess(proc, false);
+            writeSystem();
+            writeCgroups();
+        }
+
+        // Replace rate of the processes and charge CPU time, every tick.
+        void churn(double rate, int ticks, chron::milliseconds tick)
+        {
+            std::bernoulli_distribution busy(0.2);
+            std::uniform_real_distribution<double> load(0.1, 0.6);
+            for(int t = 0; t < ticks; t++)
+            {
+                std::this_thread::sleep_for(tick);
+                auto elapsed = static_cast<unsigned long long>(tick.count())
+                    * TICKS_PER_SEC / 1000;
+                auto busyTicks = static_cast<unsigned long long>
+                    (load(mRng) * static_cast<double>(elapsed));
+                mUptime += elapsed;
+                mCpuBusy += busyTicks;
+                mCpuIdle += elapsed - busyTicks;
+
+                auto turnover = static_cast<int>
+                    (std::lround(rate * static_cast<double>(mLive)));
+                int births = 0;
+                int deaths = 0;
+                for(int i = 0; i < turnover; i++)
+                    deaths += killLeaf();
+                for(int i = 0; i < turnover; i++)
+                {
+                    auto &proc = mProcesses[spawn(pickParent(), nullptr,
+                                                  false, mUptime)];
+                    writeProcess(proc, true);
+                    births++;
+                }
+
+                for(auto &proc : mProcesses)
+                    if(proc.alive && !proc.kernel && busy(mRng))
+                    {
+                        proc.utime += mRng() % 10;
+                        proc.stime += mRng() % 3;
+                        proc.readBytes += mRng() % 65536;
+                        proc.writeBytes += mRng() % 16384;
+                        writeTaskFile(proc, 0, "stat", true);
+                        writeTaskFile(proc, 0, "io", true);
+                    }
+                writeSystem();
+                writeCgroups();
+                std::printf("tick %d: %d processes, %d births, %d deaths\n",
+                            t + 1, mLive, births, deaths);
+                std::fflush(stdout);
+            }
+        }
+
+    private:
+        // Add a process under ppid, named name (or one picked at random),
+        // returning its index in mProcesses.
+        std::size_t spawn(int ppid, const char *name, bool kernel,
+                          unsigned long long startTime)
+        {
+            Process proc;
+            proc.pid = allocatePid();
+            proc.ppid = ppid;
+            proc.kernel = kernel;
+            proc.alive = true;
+            proc.startTime = startTime;
+            proc.name = name ? name
+                : USER_NAMES[zipf(std::size(USER_NAMES))];
+            if(!kernel)
+            {
+                proc.uid = USER_IDS[mRng() % std::size(USER_IDS)];
+                // Mostly small, with a long tail.
+                std::lognormal_distribution<double> rss(8., 1.5);
+                proc.rssPages = static_cast<unsigned long>
+                    (std::min(rss(mRng), 4e6));
+                // Most processes have one thread; some have dozens.
+                if(mRng() % 10 >= 7)
+                {
+                    std::geometric_distribution<int> extra(0.15);
+                    int n = std::min(extra(mRng) + 1, 128);
+                    for(int i = 0; i < n; i++)
+                        proc.threads.push_back(allocatePid());
+                }
+                auto life = std::max(1ull, mUptime - startTime);
+                proc.utime = mRng() % (life / 20 + 1);
+                proc.stime = proc.utime / 4;
+            }
+            // Kernel threads stay in the root.
+            if(ppid == 0 && !kernel)
+                proc.cgroup = INIT_SCOPE;
+            else if(ppid == 1)
+                proc.cgroup = addService(proc);
+            else if(ppid > 0)
+                proc.cgroup = mProcesses[mSlots[ppid]].cgroup;
+
+            std::size_t index = mProcesses.size();
+            mSlots[proc.pid] = static_cast<int>(index);
+            for(int tid : proc.threads)
+                mSlots[tid] = static_cast<int>(index);
+            if(ppid > 0)
+            {
+                auto &parent = mProcesses[mSlots[ppid]];
+                parent.children++;
+                // Every child is another ticket for its parent, so busy
+                // parents get busier.
+                if(!parent.kernel && ppid != 1)
+                    mUrn.push_back(ppid);
+            }
+            if(!kernel && proc.pid != 1)
+                mUrn.push_back(proc.pid);
+            mProcesses.push_back(std::move(proc));
+            mLive++;
+            return index;
+        }
+
+        // The next free pid, wrapping like the kernel's.
+        int allocatePid()
+        {
+            for(;;)
+            {
+                int pid = mNextPid++;
+                if(mNextPid >= PID_MAX)
+                    mNextPid = 300;
+                if(mSlots[pid] < 0 || !mProcesses[mSlots[pid]].alive)
+                    return pid;
+            }
+        }
+
+        // Some user processes are services straight under init; the rest
+        // fork from something already running, in proportion to how many
+        // children it already has. That gives a few wide nodes, many
+        // leaves and depth growing with the log of the count.
+        int pickParent()
+        {
+            if(mUrn.empty() || mRng() % 20 == 0)
+                return 1;
+            for(int tries = 0; !mUrn.empty(); tries++)
+            {
+                int pid = mUrn[mRng() % mUrn.size()];
+                if(mProcesses[mSlots[pid]].alive)
+                    return pid;
+                // Mostly the dead: sweep them out.
+                if(tries == 16)
+                {
+                    mUrn.erase(std::remove_if(mUrn.begin(), mUrn.end(),
+                                              [this](int pid)
+                    {
+                        return !mProcesses[mSlots[pid]].alive;
+                    }), mUrn.end());
+                    tries = 0;
+                }
+            }
+            return 1;
+        }
+
+        // Index into a table of n, the first entries most likely.
+        std::size_t zipf(std::size_t n)
+        {
+            std::uniform_real_distribution<double> u(0., 1.);
+            auto i = static_cast<std::size_t>(std::pow(u(mRng), 2.)
+                                              * static_cast<double>(n));
+            return std::min(i, n - 1);
+        }
+
+        // Remove a random user process with no children. Returns 0 if
+        // none was found after a few tries.
+        int killLeaf()
+        {
+            for(int tries = 0; tries < 64; tries++)
+            {
+                auto &proc = mProcesses[mRng() % mProcesses.size()];
+                if(!proc.alive || proc.kernel || proc.children
+                   || proc.pid == 1)
+                    continue;
+                removeProcess(proc);
+                return 1;
+            }
+            return 0;
+        }
+
+        void removeProcess(Process &proc)
+        {
+            std::string dir = mRoot + "/" + std::to_string(proc.pid);
+            std::vector<int> tids = proc.threads;
+            tids.push_back(proc.pid);
+            for(int tid : tids)
+            {
+                std::string task = dir + "/task/" + std::to_string(tid);
+                for(const char *name : TASK_FILES)
+                    unlink((task + "/" + name).c_str());
+                rmdir(task.c_str());
+            }
+            rmdir((dir + "/task").c_str());
+            for(const char *name : PROCESS_FILES)
+                unlink((dir + "/" + name).c_str());
+            rmdir(dir.c_str());
+
+            proc.alive = false;
+            mCgroups[proc.cgroup].deadTicks += proc.utime + proc.stime;
+            mProcesses[mSlots[proc.ppid]].children--;
+            mLive--;
+        }
+
+        static constexpr const char *TASK_FILES[] =
+        {
+            "stat", "statm", "status", "comm",
+        };
+        static constexpr const char *PROCESS_FILES[] =
+        {
+            "stat", "statm", "status", "comm", "cmdline", "io",
+            "smaps_rollup", "cgroup",
+        };
+
+        void writeProcess(const Process &proc, bool atomic)
+        {
+            std::string dir = mRoot + "/" + std::to_string(proc.pid);
+            makeDir(dir);
+            makeDir(dir + "/task");
+            for(const char *name : PROCESS_FILES)
+                writeTaskFile(proc, 0, name, atomic);
+            std::vector<int> tids = proc.threads;
+            tids.push_back(proc.pid);
+            for(int tid : tids)
+            {
+                makeDir(dir + "/task/" + std::to_string(tid));
+                for(const char *name : TASK_FILES)
+                    writeTaskFile(proc, tid, name, atomic);
+            }
+        }
+
+        // Write one of proc's files, or one of thread tid's if tid is not
+        // 0.
+        void writeTaskFile(const Process &proc, int tid, const char *name,
+                           bool atomic)
+        {
+            int id = tid ? tid : proc.pid;
+            std::string path = mRoot + "/" + std::to_string(proc.pid) + "/";
+            if(tid)
+                path += "task/" + std::to_string(tid) + "/";
+            path += name;
+
+            auto numThreads = proc.threads.size() + 1;
+            unsigned long long vsize = proc.kernel ? 0
+                : proc.rssPages * PAGE_KB * 1024 * 4 + (64ull << 20);
+            int len = 0;
+            if(!std::strcmp(name, "stat"))
+            {
+                // Fields 1 to 52; threads share the leader's times.
+                len = std::snprintf
+                    (mBuf, sizeof(mBuf),
+                     "%d (%s) %c %d %d %d 0 -1 %u 1024 0 0 0 %llu %llu 0 0 "
+                     "20 0 %zu 0 %llu %llu %lu 18446744073709551615 1 1 0 "
+                     "0 0 0 0 0 0 0 0 0 17 %d 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+                     id, proc.name.c_str(), proc.kernel ? 'I' : 'S',
+                     proc.ppid, proc.pid, proc.pid,
+                     proc.kernel ? 0x208040u : 0x400100u, proc.utime,
+                     proc.stime, numThreads, proc.startTime, vsize,
+                     proc.rssPages, id % 64);
+            }
+            else if(!std::strcmp(name, "statm"))
+                len = std::snprintf(mBuf, sizeof(mBuf),
+                                    "%llu %lu %lu 1 0 %lu 0\n",
+                                    vsize / (PAGE_KB * 1024), proc.rssPages,
+                                    proc.rssPages / 4, proc.rssPages / 2);
+            else if(!std::strcmp(name, "status"))
+                len = std::snprintf
+                    (mBuf, sizeof(mBuf),
+                     "Name:\t%s\nUmask:\t0022\nState:\t%s\nTgid:\t%d\n"
+                     "Ngid:\t0\nPid:\t%d\nPPid:\t%d\nTracerPid:\t0\n"
+                     "Uid:\t%u\t%u\t%u\t%u\nGid:\t%u\t%u\t%u\t%u\n"
+                     "VmRSS:\t%lu kB\nThreads:\t%zu\n",
+                     proc.name.c_str(),
+                     proc.kernel ? "I (idle)" : "S (sleeping)", proc.pid,
+                     id, proc.ppid, proc.uid, proc.uid, proc.uid, proc.uid,
+                     proc.uid, proc.uid, proc.uid, proc.uid,
+                     proc.rssPages * PAGE_KB, numThreads);
+            else if(!std::strcmp(name, "comm"))
+                len = std::snprintf(mBuf, sizeof(mBuf), "%.15s\n",
+                                    proc.name.c_str());
+            else if(!std::strcmp(name, "cmdline"))
+            {
+                // NUL separated; empty for kernel threads.
+                if(!proc.kernel)
+                    len = std::snprintf(mBuf, sizeof(mBuf),
+                                        "/usr/bin/%s%c--id=%d%c",
+                                        proc.name.c_str(), '\0', proc.pid,
+                                        '\0');
+            }
+            else if(!std::strcmp(name, "io"))
+                len = std::snprintf
+                    (mBuf, sizeof(mBuf),
+                     "rchar: %llu\nwchar: %llu\nsyscr: %llu\nsyscw: %llu\n"
+                     "read_bytes: %llu\nwrite_bytes: %llu\n"
+                     "cancelled_write_bytes: 0\n",
+                     proc.readBytes, proc.writeBytes, proc.readBytes / 4096,
+                     proc.writeBytes / 4096, proc.readBytes,
+                     proc.writeBytes);
+            else if(!std::strcmp(name, "smaps_rollup"))
+            {
+                unsigned long rss = proc.rssPages * PAGE_KB;
+                len = std::snprintf
+                    (mBuf, sizeof(mBuf),
+                     "00400000-7fffffffffff ---p 00000000 00:00 0"
+                     "                  [rollup]\n"
+                     "Rss:            %8lu kB\nPss:            %8lu kB\n"
+                     "Shared_Clean:   %8lu kB\nShared_Dirty:          0 kB\n"
+                     "Private_Clean:  %8lu kB\nPrivate_Dirty:  %8lu kB\n"
+                     "SwapPss:               0 kB\n",
+                     rss, rss * 3 / 4, rss / 2, rss / 4, rss / 4);
+            }
+            else if(!std::strcmp(name, "cgroup"))
+                len = std::snprintf(mBuf, sizeof(mBuf), "0::%s\n",
+                                    mCgroups[proc.cgroup].path.c_str());
+            writeFile(path, std::string(mBuf, static_cast<std::size_t>
+                                        (std::max(len, 0))), atomic);
+        }
+
+        // uptime, loadavg, meminfo and stat. gltop keeps these open and
+        // re-reads them, so they are rewritten in place, not replaced.
+        void writeSystem()
+        {
+            double seconds = static_cast<double>(mUptime)
+                / static_cast<double>(TICKS_PER_SEC);
+            std::snprintf(mBuf, sizeof(mBuf), "%.2f %.2f\n", seconds,
+                          seconds * 0.9);
+            rewriteFile(mRoot + "/uptime", mBuf);
+
+            std::snprintf(mBuf, sizeof(mBuf), "1.50 1.25 1.00 3/%d %d\n",
+                          mLive, mNextPid - 1);
+            rewriteFile(mRoot + "/loadavg", mBuf);
+
+            unsigned long long rss = 0;
+            for(auto &proc : mProcesses)
+                if(proc.alive)
+                    rss += proc.rssPages * PAGE_KB;
+            unsigned long long total = std::max(rss * 2, 16ull << 20);
+            std::snprintf(mBuf, sizeof(mBuf),
+                          "MemTotal:       %llu kB\nMemFree:        %llu kB\n"
+                          "MemAvailable:   %llu kB\nBuffers:        %llu kB\n"
+                          "Cached:         %llu kB\nSwapCached:     0 kB\n"
+                          "SwapTotal:      %llu kB\nSwapFree:       %llu kB\n",
+                          total, total - rss, total - rss, total / 64,
+                          total / 8, total / 4, total / 4);
+            rewriteFile(mRoot + "/meminfo", mBuf);
+
+            // Four CPUs, equally busy.
+            std::string stat;
+            auto idle = mCpuIdle;
+            auto busy = mCpuBusy;
+            std::snprintf(mBuf, sizeof(mBuf),
+                          "cpu  %llu 0 %llu %llu 0 0 0 0 0 0\n", busy * 3,
+                          busy, idle * 4);
+            stat += mBuf;
+            for(int cpu = 0; cpu < 4; cpu++)
+            {
+                std::snprintf(mBuf, sizeof(mBuf),
+                              "cpu%d %llu 0 %llu %llu 0 0 0 0 0 0\n", cpu,
+                              busy * 3 / 4, busy / 4, idle);
+                stat += mBuf;
+            }
+            std::snprintf(mBuf, sizeof(mBuf),
+                          "ctxt %llu\nbtime 1700000000\nprocesses %d\n"
+                          "procs_running 3\nprocs_blocked 0\n", mUptime * 50,
+                          mNextPid - 1);
+            stat += mBuf;
+            rewriteFile(mRoot + "/stat", stat);
+        }
+
+        static constexpr int ROOT_CGROUP = 0;
+        static constexpr int INIT_SCOPE = 1;
+        static constexpr int SYSTEM_SLICE = 2;
+        static constexpr int USER_SLICE = 3;
+
+        // Add a cgroup named name under parent (the root if parent is -1),
+        // returning its index.
+        int addCgroup(int parent, const std::string &name)
+        {
+            Cgroup cgroup;
+            cgroup.parent = parent;
+            if(parent < 0)
+                cgroup.path = "/";
+            else if(parent == ROOT_CGROUP)
+                cgroup.path = "/" + name;
+            else
+                cgroup.path = mCgroups[parent].path + "/" + name;
+            if(!mCgroupRoot.empty() && parent >= 0)
+                makeDir(mCgroupRoot + cgroup.path);
+            mCgroups.push_back(std::move(cgroup));
+            return static_cast<int>(mCgroups.size()) - 1;
+        }
+
+        // The cgroup of a new process under init: a service of its own,
+        // or a session scope if a user started it.
+        int addService(const Process &proc)
+        {
+            if(proc.uid < 1000)
+                return addCgroup(SYSTEM_SLICE, proc.name + "@"
+                                 + std::to_string(proc.pid) + ".service");
+            auto slice = mUserSlices.find(proc.uid);
+            if(slice == mUserSlices.end())
+                slice = mUserSlices.emplace
+                    (proc.uid, addCgroup(USER_SLICE, "user-"
+                                         + std::to_string(proc.uid)
+                                         + ".slice")).first;
+            return addCgroup(slice->second, "session-"
+                             + std::to_string(++mSessions) + ".scope");
+        }
+
+        // cpu.stat, memory.current and pids.current of every cgroup, each
+        // counting everything below it. The root only has cpu.stat, as on
+        // a real system.
+        void writeCgroups()
+        {
+            if(mCgroupRoot.empty())
+                return;
+            std::vector<unsigned long long> ticks(mCgroups.size());
+            std::vector<unsigned long long> memory(mCgroups.size());
+            std::vector<unsigned long long> pids(mCgroups.size());
+            for(std::size_t i = 0; i < mCgroups.size(); i++)
+                ticks[i] = mCgroups[i].deadTicks;
+            for(auto &proc : mProcesses)
+                if(proc.alive)
+                {
+                    ticks[proc.cgroup] += proc.utime + proc.stime;
+                    memory[proc.cgroup] += proc.rssPages * PAGE_KB * 1024;
+                    pids[proc.cgroup] += proc.threads.size() + 1;
+                }
+            // Children come after their parents, so walking backwards
+            // adds each group's totals in before its parent's are passed
+            // up.
+            for(auto i = mCgroups.size(); i-- > 1;)
+            {
+                auto parent = static_cast<std::size_t>(mCgroups[i].parent);
+                ticks[parent] += ticks[i];
+                memory[parent] += memory[i];
+                pids[parent] += pids[i];
+            }
+
+            for(std::size_t i = 0; i < mCgroups.size(); i++)
+            {
+                // The root's path is "/", the mount itself.
+                std::string dir = mCgroupRoot + (i ? mCgroups[i].path : "");
+                auto usec = ticks[i] * (1000000 / TICKS_PER_SEC);
+                std::snprintf(mBuf, sizeof(mBuf),
+                              "usage_usec %llu\nuser_usec %llu\n"
+                              "system_usec %llu\n", usec, usec * 4 / 5,
+                              usec / 5);
+                rewriteFile(dir + "/cpu.stat", mBuf);
+                if(i == 0)
+                    continue;
+                rewriteFile(dir + "/memory.current",
+                            std::to_string(memory[i]) + "\n");
+                rewriteFile(dir + "/pids.current",
+                            std::to_string(pids[i]) + "\n");
+            }
+        }
+
+        static void makeDir(const std::string &path)
+        {
+            if(mkdir(path.c_str(), 0755) < 0 && errno != EEXIST)
+                throw std::runtime_error("Could not create " + path + ": "
+                                         + std::strerror(errno));
+        }
+
+        // Write data to path, through a temporary and a rename if atomic.
+        static void writeFile(const std::string &path,
+                              const std::string &data, bool atomic)
+        {
+            std::string target = atomic ? path + ".tmp" : path;
+            int fd = open(target.c_str(),
+                          O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if(fd < 0 || write(fd, data.data(), data.size())
+               != static_cast<ssize_t>(data.size()))
+            {
+                std::string error = std::strerror(errno);
+                if(fd >= 0)
+                    close(fd);
+                throw std::runtime_error("Could not write " + path + ": "
+                                         + error);
+            }
+            close(fd);
+            if(atomic && rename(target.c_str(), path.c_str()) < 0)
+                throw std::runtime_error("Could not rename " + target + ": "
+                                         + std::strerror(errno));
+        }
+
+        // Overwrite path with data, keeping the file (and whoever has it
+        // open) rather than replacing it. A reader may catch it half
+        // written, much less likely than it missing every update.
+        static void rewriteFile(const std::string &path,
+                                const std::string &data)
+        {
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC,
+                          0644);
+            if(fd < 0 || pwrite(fd, data.data(), data.size(), 0)
+               != static_cast<ssize_t>(data.size())
+               || ftruncate(fd, static_cast<off_t>(data.size())) < 0)
+            {
+                std::string error = std::strerror(errno);
+                if(fd >= 0)
+                    close(fd);
+                throw std::runtime_error("Could not write " + path + ": "
+                                         + error);
+            }
+            close(fd);
+        }
+
+        std::string mRoot;
+        // Where the cgroup tree goes; empty for none.
+        std::string mCgroupRoot;
+        std::mt19937 mRng;
+        // Every process ever spawned; dead ones stay, marked, so indices
+        // hold.
+        std::vector<Process> mProcesses;
+        // Index into mProcesses by pid or tid, or -1.
+        std::vector<int> mSlots;
+        // A pid per user process but init, plus one per child it ever had;
+        // drawing from it is preferential attachment.
+        std::vector<int> mUrn;
+        std::vector<Cgroup> mCgroups;
+        // Each user's slice in mCgroups, and the sessions started so far.
+        std::map<unsigned, int> mUserSlices;
+        int mSessions;
+        int mLive;
+        int mNextPid;
+        unsigned long long mUptime;
+        // Busy and idle ticks of each CPU.
+        unsigned long long mCpuBusy;
+        unsigned long long mCpuIdle;
+        char mBuf[1024];
+    };
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 3)
+    {
+        std::fprintf(stderr, "Usage: %s dir n [--seed s] [--churn rate] "
+                     "[--ticks k] [--tick-ms ms] [--cgroup-root cgdir]\n",
+                     argv[0]);
+        return 1;
+    }
+    std::string root = argv[1];
+    int n = std::atoi(argv[2]);
+    if(n < 1 || n > PID_MAX / 4)
+    {
+        std::fprintf(stderr, "n must be between 1 and %d\n", PID_MAX / 4);
+        return 1;
+    }
+
+    std::string cgroupRoot;
+    unsigned seed = 1;
+    double rate = 0.;
+    int ticks = 0;
+    chron::milliseconds tick(1000);
+    for(int i = 3; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if(arg == "--seed" && i + 1 < argc)
+            seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr,
+                                                      10));
+        else if(arg == "--churn" && i + 1 < argc)
+            rate = std::atof(argv[++i]);
+        else if(arg == "--ticks" && i + 1 < argc)
+            ticks = std::atoi(argv[++i]);
+        else if(arg == "--tick-ms" && i + 1 < argc)
+            tick = chron::milliseconds(std::max(1, std::atoi(argv[++i])));
+        else if(arg == "--cgroup-root" && i + 1 < argc)
+            cgroupRoot = argv[++i];
+        else
+            std::fprintf(stderr, "Don't know what to do with argument '%s'\n",
+                         argv[i]);
+    }
+    // Churn with no tick count runs until killed.
+    if(rate > 0. && ticks == 0)
+        ticks = -1;
+
+    try
+    {
+        Generator generator(root, cgroupRoot, seed);
+        auto start = chron::steady_clock::now();
+        generator.generate(n);
+        std::printf("wrote %d processes to %s in %.1f s\n", n, root.c_str(),
+                    chron::duration<double>(chron::steady_clock::now()
+                                            - start).count());
+        std::fflush(stdout);
+        if(rate > 0.)
+            generator.churn(rate, ticks < 0 ? 1 << 30 : ticks, tick);
+    }
+    catch(const std::exception &e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,638 @@
+extern "C" {
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#include "recorder.hpp"
+
+using namespace std::string_literals;
+namespace chron = std::chrono;
+
+namespace
+{
+    // Columns, by their bit in a change's mask.
+    enum Column
+    {
+        COLUMN_PPID,
+        COLUMN_RSS,
+        COLUMN_VSZ,
+        COLUMN_PSS,
+        COLUMN_USS,
+        COLUMN_THREADS,
+        COLUMN_CPU,
+        COLUMN_IO_READ,
+        COLUMN_IO_WRITE,
+        COLUMNS,
+    };
+
+    inline void putVarint(std::vector<std::uint8_t> &out, std::uint64_t value)
+    {
+        while(value >= 0x80)
+        {
+            out.push_back(static_cast<std::uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<std::uint8_t>(value));
+    }
+
+    // Small differences either way make small varints.
+    inline void putZigzag(std::vector<std::uint8_t> &out, std::int64_t value)
+    {
+        putVarint(out, (static_cast<std::uint64_t>(value) << 1)
+                  ^ static_cast<std::uint64_t>(value >> 63));
+    }
+
+    inline std::uint32_t floatBits(float value)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    inline float bitsFloat(std::uint32_t bits)
+    {
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // Read a varint at p, leaving p after it. False if it runs past end.
+    inline bool getVarint(const std::uint8_t *&p, const std::uint8_t *end,
+                          std::uint64_t &value)
+    {
+        value = 0;
+        for(unsigned shift = 0; p < end && shift < 64; shift += 7)
+        {
+            std::uint8_t byte = *p++;
+            value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if(!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    inline bool getZigzag(const std::uint8_t *&p, const std::uint8_t *end,
+                          std::int64_t &value)
+    {
+        std::uint64_t raw;
+        if(!getVarint(p, end, raw))
+            return false;
+        value = static_cast<std::int64_t>(raw >> 1)
+            ^ -static_cast<std::int64_t>(raw & 1);
+        return true;
+    }
+
+    inline std::int64_t difference(unsigned long long a, unsigned long long b)
+    {
+        return static_cast<std::int64_t>(a - b);
+    }
+
+    // Mask of the columns of cur that differ from last.
+    unsigned getChanges(const gltop::RecordedProcess &cur,
+                        const gltop::RecordedProcess &last)
+    {
+        unsigned mask = 0;
+        mask |= (cur.ppid != last.ppid) << COLUMN_PPID;
+        mask |= (cur.rss != last.rss) << COLUMN_RSS;
+        mask |= (cur.vsz != last.vsz) << COLUMN_VSZ;
+        mask |= (cur.pss != last.pss) << COLUMN_PSS;
+        mask |= (cur.uss != last.uss) << COLUMN_USS;
+        mask |= (cur.numThreads != last.numThreads) << COLUMN_THREADS;
+        mask |= (floatBits(cur.cpu) != floatBits(last.cpu)) << COLUMN_CPU;
+        mask |= (floatBits(cur.ioRead) != floatBits(last.ioRead))
+            << COLUMN_IO_READ;
+        mask |= (floatBits(cur.ioWrite) != floatBits(last.ioWrite))
+            << COLUMN_IO_WRITE;
+        return mask;
+    }
+
+    // The masked columns of cur, against last.
+    void putChanges(std::vector<std::uint8_t> &out, unsigned mask,
+                    const gltop::RecordedProcess &cur,
+                    const gltop::RecordedProcess &last)
+    {
+        if(mask & (1u << COLUMN_PPID))
+            putZigzag(out, static_cast<std::int64_t>(cur.ppid) - last.ppid);
+        if(mask & (1u << COLUMN_RSS))
+            putZigzag(out, difference(cur.rss, last.rss));
+        if(mask & (1u << COLUMN_VSZ))
+            putZigzag(out, difference(cur.vsz, last.vsz));
+        if(mask & (1u << COLUMN_PSS))
+            putZigzag(out, difference(cur.pss, last.pss));
+        if(mask & (1u << COLUMN_USS))
+            putZigzag(out, difference(cur.uss, last.uss));
+        if(mask & (1u << COLUMN_THREADS))
+            putZigzag(out, static_cast<std::int64_t>(cur.numThreads)
+                      - last.numThreads);
+        if(mask & (1u << COLUMN_CPU))
+            putVarint(out, floatBits(cur.cpu) ^ floatBits(last.cpu));
+        if(mask & (1u << COLUMN_IO_READ))
+            putVarint(out, floatBits(cur.ioRead) ^ floatBits(last.ioRead));
+        if(mask & (1u << COLUMN_IO_WRITE))
+            putVarint(out, floatBits(cur.ioWrite) ^ floatBits(last.ioWrite));
+    }
+
+    // Apply the masked columns at p to proc.
+    bool getChanges(const std::uint8_t *&p, const std::uint8_t *end,
+                    unsigned mask, gltop::RecordedProcess &proc)
+    {
+        std::int64_t delta = 0;
+        std::uint64_t bits = 0;
+        for(unsigned column = 0; column < COLUMNS; column++)
+        {
+            if(!(mask & (1u << column)))
+                continue;
+            bool isFloat = column >= COLUMN_CPU;
+            if(isFloat ? !getVarint(p, end, bits) : !getZigzag(p, end, delta))
+                return false;
+            auto xorBits = [&](float value)
+            {
+                return bitsFloat(floatBits(value)
+                                 ^ static_cast<std::uint32_t>(bits));
+            };
+            switch(column)
+            {
+            case COLUMN_PPID:
+                proc.ppid += static_cast<int>(delta);
+                break;
+            case COLUMN_RSS:
+                proc.rss += static_cast<unsigned long>(delta);
+                break;
+            case COLUMN_VSZ:
+                proc.vsz += static_cast<unsigned long>(delta);
+                break;
+            case COLUMN_PSS:
+                proc.pss += static_cast<unsigned long>(delta);
+                break;
+            case COLUMN_USS:
+                proc.uss += static_cast<unsigned long>(delta);
+                break;
+            case COLUMN_THREADS:
+                proc.numThreads += static_cast<long>(delta);
+                break;
+            case COLUMN_CPU:
+                proc.cpu = xorBits(proc.cpu);
+                break;
+            case COLUMN_IO_READ:
+                proc.ioRead = xorBits(proc.ioRead);
+                break;
+            case COLUMN_IO_WRITE:
+                proc.ioWrite = xorBits(proc.ioWrite);
+                break;
+            }
+        }
+        return true;
+    }
+
+    const gltop::RecordedProcess NOTHING;
+
+    // Offset just past the last complete record (or header) of the log in
+    // file, which is size bytes long; -1 if it is not a session log.
+    off_t findLogEnd(std::FILE *file, off_t size)
+    {
+        using gltop::SessionEncoder;
+        off_t end = -1;
+        for(;;)
+        {
+            int kind = std::fgetc(file);
+            if(kind == SessionEncoder::MAGIC[0])
+            {
+                char magic[SessionEncoder::MAGIC_SIZE - 1];
+                if(std::fread(magic, 1, sizeof(magic), file) != sizeof(magic)
+                   || std::memcmp(magic, SessionEncoder::MAGIC + 1,
+                                  sizeof(magic)) != 0)
+                    return end;
+                end = ftello(file);
+                continue;
+            }
+            if(end < 0 || (kind != SessionEncoder::KEYFRAME
+                           && kind != SessionEncoder::DELTA))
+                return end;
+
+            std::uint64_t length = 0;
+            for(unsigned shift = 0;; shift += 7)
+            {
+                int byte = std::fgetc(file);
+                if(byte == EOF || shift >= 64)
+                    return end;
+                length |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                if(!(byte & 0x80))
+                    break;
+            }
+            off_t start = ftello(file);
+            if(length > static_cast<std::uint64_t>(size - start)
+               || fseeko(file, static_cast<off_t>(length), SEEK_CUR) != 0)
+                return end;
+            end = start + static_cast<off_t>(length);
+        }
+    }
+}
+
+void gltop::RecordedSnapshot::assign(const ProcessStore &store,
+                                     const SystemStats &system,
+                                     std::uint64_t snapshotSequence)
+{
+    sequence = snapshotSequence;
+    time = chron::duration_cast<chron::milliseconds>
+        (chron::system_clock::now().time_since_epoch()).count();
+    cpuBusy = system.cpuBusy;
+    load = static_cast<float>(system.load[0]);
+    memAvailable = system.memAvailable;
+
+    processes.resize(store.size());
+    for(std::size_t i = 0; i < store.size(); i++)
+    {
+        auto &proc = processes[i];
+        proc.pid = store.getTids()[i];
+        proc.ppid = store.getPPids()[i];
+        proc.startTime = store.getStartTimes()[i];
+        proc.name.assign(store.getName(store.getNameIds()[i]));
+        proc.rss = store.getRSS()[i];
+        proc.vsz = store.getVMem()[i];
+        proc.pss = store.getPSS()[i];
+        proc.uss = store.getUSS()[i];
+        proc.numThreads = store.get(static_cast<int>(i)).getNumThreads();
+        proc.cpu = store.getCPU()[i];
+        proc.ioRead = store.getIoRead()[i];
+        proc.ioWrite = store.getIoWrite()[i];
+    }
+}
+
+gltop::SessionEncoder::SessionEncoder()
+    : mLast(),mSinceKeyframe(KEYFRAME_INTERVAL),mDeaths(),mBirths(),
+      mChanges(),mBody()
+{
+}
+
+void gltop::SessionEncoder::encode(const RecordedSnapshot &snapshot,
+                                   std::vector<std::uint8_t> &out)
+{
+    bool keyframe = mSinceKeyframe >= KEYFRAME_INTERVAL;
+    if(keyframe)
+    {
+        mLast = RecordedSnapshot();
+        mSinceKeyframe = 0;
+    }
+    mSinceKeyframe++;
+
+    // Both lists are in pid order, so one merge finds the deaths, births
+    // and changes.
+    const auto &last = mLast.processes;
+    const auto &cur = snapshot.processes;
+    mDeaths.clear();
+    mBirths.clear();
+    mChanges.clear();
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while(i < last.size() || j < cur.size())
+    {
+        if(j == cur.size() || (i < last.size() && last[i].pid < cur[j].pid))
+        {
+            mDeaths.push_back(static_cast<int>(i++));
+            continue;
+        }
+        int lastSlot = -1;
+        if(i < last.size() && last[i].pid == cur[j].pid)
+        {
+            if(last[i].startTime == cur[j].startTime)
+                lastSlot = static_cast<int>(i);
+            else
+                mDeaths.push_back(static_cast<int>(i));
+            i++;
+        }
+        if(lastSlot < 0)
+            mBirths.push_back(static_cast<int>(j));
+        if(getChanges(cur[j], lastSlot < 0 ? NOTHING : last[lastSlot]))
+            mChanges.emplace_back(static_cast<int>(j), lastSlot);
+        j++;
+    }
+
+    mBody.clear();
+    putVarint(mBody, snapshot.sequence);
+    putZigzag(mBody, snapshot.time - mLast.time);
+    putVarint(mBody, floatBits(snapshot.cpuBusy) ^ floatBits(mLast.cpuBusy));
+    putVarint(mBody, floatBits(snapshot.load) ^ floatBits(mLast.load));
+    putZigzag(mBody, difference(snapshot.memAvailable, mLast.memAvailable));
+
+    int pid = 0;
+    putVarint(mBody, mDeaths.size());
+    for(int slot : mDeaths)
+    {
+        putVarint(mBody, static_cast<std::uint64_t>(last[slot].pid - pid));
+        pid = last[slot].pid;
+    }
+    pid = 0;
+    putVarint(mBody, mBirths.size());
+    for(int slot : mBirths)
+    {
+        const auto &proc = cur[slot];
+        putVarint(mBody, static_cast<std::uint64_t>(proc.pid - pid));
+        pid = proc.pid;
+        putVarint(mBody, proc.startTime);
+        putVarint(mBody, proc.name.size());
+        mBody.insert(mBody.end(), proc.name.begin(), proc.name.end());
+    }
+    pid = 0;
+    putVarint(mBody, mChanges.size());
+    for(auto [slot, lastSlot] : mChanges)
+    {
+        const auto &proc = cur[slot];
+        const auto &base = (lastSlot < 0) ? NOTHING : last[lastSlot];
+        unsigned mask = getChanges(proc, base);
+        putVarint(mBody, static_cast<std::uint64_t>(proc.pid - pid));
+        pid = proc.pid;
+        putVarint(mBody, mask);
+        putChanges(mBody, mask, proc, base);
+    }
+
+    out.push_back(keyframe ? KEYFRAME : DELTA);
+    putVarint(out, mBody.size());
+    out.insert(out.end(), mBody.begin(), mBody.end());
+    mLast = snapshot;
+}
+
+gltop::SessionDecoder::SessionDecoder(const std::string &path)
+    : mFile(std::fopen(path.c_str(), "rb")),mState(),mKeyframe(false),
+      mBody(),mDeaths(),mNext()
+{
+    if(!mFile)
+        throw std::runtime_error("Could not open "s + path + ": "
+                                 + std::strerror(errno));
+    char magic[SessionEncoder::MAGIC_SIZE];
+    if(std::fread(magic, 1, sizeof(magic), mFile) != sizeof(magic)
+       || std::memcmp(magic, SessionEncoder::MAGIC, sizeof(magic)) != 0)
+    {
+        std::fclose(mFile);
+        throw std::runtime_error(path + " is not a gltop session log");
+    }
+}
+
+gltop::SessionDecoder::~SessionDecoder()
+{
+    std::fclose(mFile);
+}
+
+bool gltop::SessionDecoder::next()
+{
+    int kind = std::fgetc(mFile);
+    // A later session's header.
+    if(kind == SessionEncoder::MAGIC[0])
+    {
+        char magic[SessionEncoder::MAGIC_SIZE - 1];
+        if(std::fread(magic, 1, sizeof(magic), mFile) != sizeof(magic)
+           || std::memcmp(magic, SessionEncoder::MAGIC + 1, sizeof(magic))
+           != 0)
+            return false;
+        kind = std::fgetc(mFile);
+    }
+    if(kind != SessionEncoder::KEYFRAME && kind != SessionEncoder::DELTA)
+        return false;
+
+    std::uint64_t size = 0;
+    for(unsigned shift = 0;; shift += 7)
+    {
+        int byte = std::fgetc(mFile);
+        if(byte == EOF || shift >= 64)
+            return false;
+        size |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if(!(byte & 0x80))
+            break;
+    }
+    mBody.resize(size);
+    if(std::fread(mBody.data(), 1, size, mFile) != size)
+        return false;
+
+    mKeyframe = (kind == SessionEncoder::KEYFRAME);
+    if(mKeyframe)
+        mState = RecordedSnapshot();
+    return apply(mBody.data(), mBody.data() + mBody.size());
+}
+
+bool gltop::SessionDecoder::apply(const std::uint8_t *p,
+                                  const std::uint8_t *end)
+{
+    std::uint64_t value = 0;
+    std::int64_t delta = 0;
+    if(!getVarint(p, end, mState.sequence) || !getZigzag(p, end, delta))
+        return false;
+    mState.time += delta;
+    if(!getVarint(p, end, value))
+        return false;
+    mState.cpuBusy = bitsFloat(floatBits(mState.cpuBusy)
+                               ^ static_cast<std::uint32_t>(value));
+    if(!getVarint(p, end, value))
+        return false;
+    mState.load = bitsFloat(floatBits(mState.load)
+                            ^ static_cast<std::uint32_t>(value));
+    if(!getZigzag(p, end, delta))
+        return false;
+    mState.memAvailable += static_cast<unsigned long>(delta);
+
+    std::uint64_t count = 0;
+    int pid = 0;
+    if(!getVarint(p, end, count))
+        return false;
+    mDeaths.clear();
+    for(std::uint64_t n = 0; n < count; n++)
+    {
+        if(!getVarint(p, end, value))
+            return false;
+        pid += static_cast<int>(value);
+        mDeaths.push_back(pid);
+    }
+
+    // Merge the survivors with the births into mNext, in pid order.
+    if(!getVarint(p, end, count))
+        return false;
+    const auto &last = mState.processes;
+    mNext.clear();
+    std::size_t i = 0;
+    std::size_t death = 0;
+    auto takeSurvivors = [&](int below)
+    {
+        for(; i < last.size() && last[i].pid < below; i++)
+        {
+            while(death < mDeaths.size() && mDeaths[death] < last[i].pid)
+                death++;
+            if(death < mDeaths.size() && mDeaths[death] == last[i].pid)
+                continue;
+            mNext.push_back(last[i]);
+        }
+    };
+    pid = 0;
+    for(std::uint64_t n = 0; n < count; n++)
+    {
+        std::uint64_t startTime = 0;
+        std::uint64_t length = 0;
+        if(!getVarint(p, end, value) || !getVarint(p, end, startTime)
+           || !getVarint(p, end, length)
+           || length > static_cast<std::uint64_t>(end - p))
+            return false;
+        pid += static_cast<int>(value);
+        // A reused pid's old process is among the deaths.
+        takeSurvivors(pid + 1);
+        auto &proc = mNext.emplace_back();
+        proc.pid = pid;
+        proc.startTime = startTime;
+        proc.name.assign(reinterpret_cast<const char *>(p), length);
+        p += length;
+    }
+    takeSurvivors(std::numeric_limits<int>::max());
+    mState.processes.swap(mNext);
+
+    // Changes are in pid order too.
+    if(!getVarint(p, end, count))
+        return false;
+    auto &processes = mState.processes;
+    std::size_t slot = 0;
+    pid = 0;
+    for(std::uint64_t n = 0; n < count; n++)
+    {
+        std::uint64_t mask = 0;
+        if(!getVarint(p, end, value) || !getVarint(p, end, mask))
+            return false;
+        pid += static_cast<int>(value);
+        while(slot < processes.size() && processes[slot].pid < pid)
+            slot++;
+        if(slot == processes.size() || processes[slot].pid != pid
+           || !getChanges(p, end, static_cast<unsigned>(mask),
+                          processes[slot]))
+            return false;
+    }
+    return p == end;
+}
+
+gltop::SessionRecorder::SessionRecorder(const std::string &path)
+    : mFd(open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+               0644)),
+      mPath(path),mEncoder(),mSnapshot(),mRecord(),mLock(),mWake(),
+      mPending(),mBytes(0),mStopping(false),mWriting(),mThread()
+{
+    if(mFd < 0)
+        throw std::runtime_error("Could not open "s + path + ": "
+                                 + std::strerror(errno));
+
+    // Appending to an old log is fine; to anything else is not. A record
+    // a crash left half written is cut off first, or the decoder would
+    // take this session's header and records as the rest of it.
+    struct stat st;
+    off_t end = -1;
+    if(fstat(mFd, &st) == 0 && st.st_size == 0)
+        end = 0;
+    else if(std::FILE *check = std::fopen(path.c_str(), "rb"))
+    {
+        end = findLogEnd(check, st.st_size);
+        std::fclose(check);
+    }
+    if(end < 0)
+    {
+        close(mFd);
+        throw std::runtime_error(path + " is not a gltop session log");
+    }
+    if(end < st.st_size)
+    {
+        std::cerr << "Cutting " << st.st_size - end << " bytes of an "
+                  << "unfinished record off " << path << ".\n";
+        if(ftruncate(mFd, end) != 0)
+        {
+            close(mFd);
+            throw std::runtime_error("Could not truncate "s + path + ": "
+                                     + std::strerror(errno));
+        }
+    }
+
+    mPending.assign(SessionEncoder::MAGIC,
+                    SessionEncoder::MAGIC + SessionEncoder::MAGIC_SIZE);
+    mBytes = mPending.size();
+    mThread = std::thread(&SessionRecorder::run, this);
+}
+
+gltop::SessionRecorder::~SessionRecorder()
+{
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    mWake.notify_one();
+    mThread.join();
+    close(mFd);
+}
+
+void gltop::SessionRecorder::record(const ProcessStore &store,
+                                    const SystemStats &system,
+                                    std::uint64_t sequence)
+{
+    mSnapshot.assign(store, system, sequence);
+    record(mSnapshot);
+}
+
+void gltop::SessionRecorder::record(const RecordedSnapshot &snapshot)
+{
+    mRecord.clear();
+    mEncoder.encode(snapshot, mRecord);
+
+    bool flush;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mPending.insert(mPending.end(), mRecord.begin(), mRecord.end());
+        mBytes += mRecord.size();
+        flush = mPending.size() >= FLUSH_BYTES;
+    }
+    if(flush)
+        mWake.notify_one();
+}
+
+std::uint64_t gltop::SessionRecorder::getBytes()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mBytes;
+}
+
+void gltop::SessionRecorder::run()
+{
+    std::unique_lock<std::mutex> lock(mLock);
+    bool failed = false;
+    for(;;)
+    {
+        mWake.wait_for(lock, FLUSH_INTERVAL, [this]()
+        {
+            return mStopping || mPending.size() >= FLUSH_BYTES;
+        });
+        bool stopping = mStopping;
+        mWriting.swap(mPending);
+        lock.unlock();
+
+        // Once a write fails the rest are dropped; a gap in the middle of
+        // the log would make the deltas after it meaningless.
+        const std::uint8_t *p = mWriting.data();
+        std::size_t left = failed ? 0 : mWriting.size();
+        while(left)
+        {
+            ssize_t len = write(mFd, p, left);
+            if(len < 0 && errno == EINTR)
+                continue;
+            if(len <= 0)
+            {
+                std::cerr << "Could not write to " << mPath << ": "
+                          << std::strerror(errno)
+                          << ", recording stopped.\n";
+                failed = true;
+                break;
+            }
+            p += len;
+            left -= static_cast<std::size_t>(len);
+        }
+        mWriting.clear();
+
+        lock.lock();
+        if(stopping && mPending.empty())
+            return;
+    }
+}
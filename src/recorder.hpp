@@ -0,0 +1,211 @@
+#ifndef GLTOP_RECORDER_HPP
+#define GLTOP_RECORDER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "store.hpp"
+#include "system.hpp"
+
+namespace gltop
+{
+    // One process as a session log holds it.
+    struct RecordedProcess
+    {
+        int pid = 0;
+        int ppid = 0;
+        unsigned long long startTime = 0;
+        std::string name;
+        // kB.
+        unsigned long rss = 0;
+        unsigned long vsz = 0;
+        unsigned long pss = 0;
+        unsigned long uss = 0;
+        long numThreads = 0;
+        // %, and bytes per second.
+        float cpu = 0.f;
+        float ioRead = 0.f;
+        float ioWrite = 0.f;
+    };
+
+    // One snapshot as a session log holds it.
+    struct RecordedSnapshot
+    {
+        std::uint64_t sequence = 0;
+        // Wall clock time, ms since the epoch.
+        std::int64_t time = 0;
+        float cpuBusy = 0.f;
+        float load = 0.f;
+        unsigned long memAvailable = 0;
+        // In pid order.
+        std::vector<RecordedProcess> processes;
+
+        // Take the processes and system figures of one snapshot, stamped
+        // with the current time. Reuses the storage.
+        void assign(const ProcessStore &store, const SystemStats &system,
+                    std::uint64_t sequence);
+    };
+
+    // Turns a series of snapshots into session log records. A log is the
+    // 9 byte header "GLTOPREC\1" followed by records; a log appended to by
+    // a later session carries the header again before its first record.
+    // Each record is a kind byte (KEYFRAME or DELTA), its body's length as
+    // a varint, then the body:
+    //
+    //     sequence                      varint
+    //     time since the last record    zigzag varint (ms)
+    //     cpuBusy, load                 float bits XOR the last, varint
+    //     memAvailable                  zigzag varint difference
+    //     deaths                        count, then pid gaps
+    //     births                        count, then pid gap, start time,
+    //                                   name length and name each
+    //     changes                       count, then pid gap, column mask
+    //                                   and the masked columns each
+    //
+    // A keyframe is a delta from nothing: every process is born, and
+    // every non-zero column changed. Integer columns are stored as the
+    // zigzag varint difference, float columns as the XOR of their bits.
+    // Pid gaps count from the previous pid in the same list, starting at
+    // 0; lists are in pid order. A reused pid (a new start time) is a
+    // death and a birth.
+    class SessionEncoder
+    {
+    public:
+        // Record kinds.
+        static constexpr std::uint8_t KEYFRAME = 1;
+        static constexpr std::uint8_t DELTA = 2;
+        // Records between keyframes.
+        static constexpr unsigned KEYFRAME_INTERVAL = 300;
+        static constexpr char MAGIC[] = "GLTOPREC\1";
+        static constexpr std::size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+
+        SessionEncoder();
+
+        ~SessionEncoder() = default;
+
+        // Append the record for snapshot to out.
+        void encode(const RecordedSnapshot &snapshot,
+                    std::vector<std::uint8_t> &out);
+
+        // Make the next record a keyframe.
+        inline void reset()
+        {
+            mSinceKeyframe = KEYFRAME_INTERVAL;
+        }
+
+    private:
+        // What the last record left the log at.
+        RecordedSnapshot mLast;
+        unsigned mSinceKeyframe;
+        // Scratch: slots in mLast that died, slots in the snapshot born,
+        // and changed slots with their slot in mLast (-1 for births).
+        std::vector<int> mDeaths;
+        std::vector<int> mBirths;
+        std::vector<std::pair<int, int>> mChanges;
+        std::vector<std::uint8_t> mBody;
+    };
+
+    // Reads a session log back, one snapshot at a time.
+    class SessionDecoder
+    {
+    public:
+        // Throws if path cannot be opened or is not a session log.
+        SessionDecoder(const std::string &path);
+
+        ~SessionDecoder();
+
+        SessionDecoder(const SessionDecoder &) = delete;
+        SessionDecoder &operator=(const SessionDecoder &) = delete;
+
+        // Read the next record. False at the end of the log, or at a
+        // record cut short (by a crash while writing, say) or corrupt.
+        bool next();
+
+        // The snapshot as of the last record read.
+        inline const RecordedSnapshot &get() const
+        {
+            return mState;
+        }
+
+        // True if the last record read was a keyframe.
+        inline bool isKeyframe() const
+        {
+            return mKeyframe;
+        }
+
+    private:
+        // Apply the body of a record to mState.
+        bool apply(const std::uint8_t *p, const std::uint8_t *end);
+
+        std::FILE *mFile;
+        RecordedSnapshot mState;
+        bool mKeyframe;
+        std::vector<std::uint8_t> mBody;
+        // Scratch for apply().
+        std::vector<int> mDeaths;
+        std::vector<RecordedProcess> mNext;
+    };
+
+    // Appends snapshots to a session log. Encoding is done on the calling
+    // thread (the collector's, where the snapshot is at hand); the records
+    // are buffered, and written out on the recorder's own thread once
+    // FLUSH_BYTES pile up or every FLUSH_INTERVAL, so neither the
+    // collector nor the render thread waits on the disk.
+    class SessionRecorder
+    {
+    public:
+        static constexpr std::size_t FLUSH_BYTES = 256u << 10;
+        static constexpr std::chrono::milliseconds FLUSH_INTERVAL
+            = std::chrono::seconds(5);
+
+        // Append to the log at path, creating it if need be, and cutting
+        // off any unfinished record at its end. Throws if it cannot be
+        // opened, or is something other than a session log.
+        SessionRecorder(const std::string &path);
+
+        // Writes out what is buffered.
+        ~SessionRecorder();
+
+        SessionRecorder(const SessionRecorder &) = delete;
+        SessionRecorder &operator=(const SessionRecorder &) = delete;
+
+        // Add a snapshot to the log.
+        void record(const ProcessStore &store, const SystemStats &system,
+                    std::uint64_t sequence);
+
+        void record(const RecordedSnapshot &snapshot);
+
+        // Bytes recorded so far, written or not.
+        std::uint64_t getBytes();
+
+    private:
+        // Thread body: write out mPending until stopped.
+        void run();
+
+        int mFd;
+        std::string mPath;
+        // Only touched by the recording thread.
+        SessionEncoder mEncoder;
+        RecordedSnapshot mSnapshot;
+        std::vector<std::uint8_t> mRecord;
+        // Handoff to the writer.
+        std::mutex mLock;
+        std::condition_variable mWake;
+        std::vector<std::uint8_t> mPending;
+        std::uint64_t mBytes;
+        bool mStopping;
+        // Only touched by the writer.
+        std::vector<std::uint8_t> mWriting;
+        std::thread mThread;
+    };
+}
+
+#endif /* GLTOP_RECORDER_HPP */
@@ -0,0 +1,94 @@
+#include <algorithm>
+
+#include "scheduler.hpp"
+
+namespace chron = std::chrono;
+
+namespace
+{
+    // Weight of the newest scan in the smoothed figures.
+    constexpr float SMOOTHING = 0.3f;
+
+    chron::nanoseconds smooth(chron::nanoseconds average,
+                              chron::nanoseconds sample)
+    {
+        return chron::nanoseconds(static_cast<chron::nanoseconds::rep>
+                                  (SMOOTHING * sample.count()
+                                   + (1.f - SMOOTHING) * average.count()));
+    }
+
+    // Shortest interval at which cost stays within budget (% of a core).
+    chron::milliseconds getFloor(chron::nanoseconds cost, float budget)
+    {
+        return chron::ceil<chron::milliseconds>
+            (chron::duration<double, std::nano>(cost.count() * 100.
+                                                / budget));
+    }
+}
+
+gltop::ScanScheduler::ScanScheduler(chron::milliseconds base, float budget)
+    : mBase(base),mBudget(budget),mInterval(base),
+      mCore(chron::nanoseconds::zero()),mExtras(chron::nanoseconds::zero()),
+      mChurn(0.f),mShedding(false),mShedScans(0),mStarted(false)
+{
+}
+
+void gltop::ScanScheduler::update(chron::nanoseconds core,
+                                  chron::nanoseconds extras,
+                                  std::size_t processes, std::size_t births,
+                                  std::size_t deaths, float cpuSwing)
+{
+    float churn = static_cast<float>(births + deaths)
+        / static_cast<float>(std::max<std::size_t>(processes, 1))
+        + cpuSwing / 100.f;
+    if(!mStarted)
+    {
+        // Nothing to smooth against yet.
+        mStarted = true;
+        mCore = core;
+        mExtras = extras;
+    }
+    else
+        mCore = smooth(mCore, core);
+    if(mShedding && mShedScans >= SHED_PROBE_SCANS)
+    {
+        // The optional reads ran again to see if they still cost too
+        // much; the old figure says nothing about that.
+        mExtras = extras;
+        mShedScans = 0;
+    }
+    else if(mShedding)
+        mShedScans++;
+    else
+        mExtras = smooth(mExtras, extras);
+    mChurn = SMOOTHING * churn + (1.f - SMOOTHING) * mChurn;
+
+    // No budget: the base interval, churning or not.
+    if(mBudget <= 0.f)
+    {
+        mShedding = false;
+        mShedScans = 0;
+        mInterval = mBase;
+        return;
+    }
+
+    // Calm: the base interval. Churning: down to the minimum.
+    float pull = std::min(mChurn / HIGH_CHURN, 1.f);
+    auto target = mBase - chron::duration_cast<chron::milliseconds>
+        ((mBase - std::min(MIN_INTERVAL, mBase)) * pull);
+    auto floor = getFloor(mCore + mExtras, mBudget);
+    bool shedding = floor > MAX_INTERVAL;
+    if(shedding && !mShedding)
+        mShedScans = 0;
+    mShedding = shedding;
+    if(mShedding)
+        floor = getFloor(mCore, mBudget);
+    mInterval = std::clamp(std::max(target, floor), MIN_INTERVAL,
+                           MAX_INTERVAL);
+}
+
+float gltop::ScanScheduler::getUsage() const
+{
+    return 100.f * chron::duration<float>(getCost()).count()
+        / chron::duration<float>(mInterval).count();
+}
@@ -0,0 +1,102 @@
+#ifndef GLTOP_SCHEDULER_HPP
+#define GLTOP_SCHEDULER_HPP
+
+#include <chrono>
+#include <cstddef>
+
+namespace gltop
+{
+    // Picks the time between scans. A scan's cost (CPU time) over the
+    // interval is what gltop itself uses, and that is kept within a budget
+    // (% of one core) by never scanning more often than cost / budget.
+    // Within that, churn (births, deaths and swings in CPU use) pulls the
+    // interval down towards MIN_INTERVAL and calm lets it drift back to the
+    // base interval. When even MAX_INTERVAL would not fit the optional
+    // reads (I/O, PSS, cgroups) in the budget, they are shed, but for one
+    // scan in every SHED_PROBE_SCANS + 1 that measures them again.
+    class ScanScheduler
+    {
+    public:
+        static constexpr float DEFAULT_BUDGET = 2.f;
+        static constexpr std::chrono::milliseconds MIN_INTERVAL
+            = std::chrono::milliseconds(250);
+        static constexpr std::chrono::milliseconds MAX_INTERVAL
+            = std::chrono::milliseconds(10000);
+        // Churn (share of the table born or died, plus the swing in system
+        // CPU use as a fraction) at which the interval reaches the minimum.
+        static constexpr float HIGH_CHURN = 0.05f;
+        // Scans that shed the optional reads between ones that retry them.
+        static constexpr unsigned SHED_PROBE_SCANS = 10;
+
+        ScanScheduler(std::chrono::milliseconds base,
+                      float budget = DEFAULT_BUDGET);
+
+        ~ScanScheduler() = default;
+
+        // Self CPU budget, in % of one core; 0 scans at the base interval
+        // whatever it costs, and however much churn there is.
+        inline void setBudget(float budget)
+        {
+            mBudget = budget;
+        }
+
+        inline float getBudget() const
+        {
+            return mBudget;
+        }
+
+        // Account for a scan of processes tasks that found births and
+        // deaths. core is the CPU time of the scan itself, with everything
+        // else the collector did since the last one (publishing snapshots,
+        // handling events), and extras that of the optional reads (if they
+        // were not shed); cpuSwing is how far system CPU use moved since
+        // the last scan (%).
+        void update(std::chrono::nanoseconds core,
+                    std::chrono::nanoseconds extras, std::size_t processes,
+                    std::size_t births, std::size_t deaths, float cpuSwing);
+
+        // Time until the next scan.
+        inline std::chrono::milliseconds getInterval() const
+        {
+            return mInterval;
+        }
+
+        // Smoothed CPU time of a scan, and its share of one core (%) at the
+        // current interval.
+        inline std::chrono::nanoseconds getCost() const
+        {
+            return mCore + (mShedding ? std::chrono::nanoseconds::zero()
+                            : mExtras);
+        }
+
+        float getUsage() const;
+
+        // Smoothed churn, as for HIGH_CHURN.
+        inline float getChurn() const
+        {
+            return mChurn;
+        }
+
+        // True if the optional reads should be left out of the next scan.
+        inline bool isShedding() const
+        {
+            return mShedding && mShedScans < SHED_PROBE_SCANS;
+        }
+
+    private:
+        std::chrono::milliseconds mBase;
+        float mBudget;
+        std::chrono::milliseconds mInterval;
+        // Smoothed costs; while shedding, mExtras is what the optional
+        // reads cost when last retried.
+        std::chrono::nanoseconds mCore;
+        std::chrono::nanoseconds mExtras;
+        float mChurn;
+        bool mShedding;
+        // Scans shed since shedding began or the reads were last retried.
+        unsigned mShedScans;
+        bool mStarted;
+    };
+}
+
+#endif /* GLTOP_SCHEDULER_HPP */
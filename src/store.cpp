@@ -0,0 +1,254 @@
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "store.hpp"
+
+gltop::PidIndex::PidIndex()
+    : mPidMax(readPidMax()),mDirect(),mSet(),mKeys(),mSlots(),mMask(0),
+      mShift(0)
+{
+}
+
+std::size_t gltop::PidIndex::readPidMax(const std::string &procRoot)
+{
+    // The kernel's default on small machines.
+    constexpr std::size_t DEFAULT_PID_MAX = 32768;
+    char buf[32];
+    std::string path = procRoot + "/sys/kernel/pid_max";
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return DEFAULT_PID_MAX;
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if(len <= 0)
+        return DEFAULT_PID_MAX;
+    buf[len] = '\0';
+    long pidMax = std::atol(buf);
+    return (pidMax > 0) ? static_cast<std::size_t>(pidMax)
+        : DEFAULT_PID_MAX;
+}
+
+void gltop::PidIndex::build(const std::vector<int> &pids)
+{
+    int maxPid = -1;
+    for(int pid : pids)
+        maxPid = std::max(maxPid, pid);
+    std::size_t range = std::max(mPidMax,
+                                 static_cast<std::size_t>(maxPid + 1));
+
+    if(range <= DIRECT_LIMIT)
+    {
+        mKeys.clear();
+        mSlots.clear();
+        if(mDirect.size() < range)
+            mDirect.resize(range, -1);
+        for(int pid : mSet)
+            mDirect[pid] = -1;
+        for(std::size_t i = 0; i < pids.size(); i++)
+            mDirect[pids[i]] = static_cast<int>(i);
+        mSet.assign(pids.begin(), pids.end());
+        return;
+    }
+
+    // At most half full.
+    mDirect.clear();
+    mSet.clear();
+    std::size_t capacity = 16;
+    unsigned bits = 4;
+    while(capacity < 2 * pids.size())
+    {
+        capacity *= 2;
+        bits++;
+    }
+    mMask = capacity - 1;
+    mShift = 32 - bits;
+    mKeys.assign(capacity, -1);
+    mSlots.resize(capacity);
+    for(std::size_t i = 0; i < pids.size(); i++)
+    {
+        std::size_t j = hash(pids[i]);
+        while(mKeys[j] >= 0 && mKeys[j] != pids[i])
+            j = (j + 1) & mMask;
+        mKeys[j] = pids[i];
+        mSlots[j] = static_cast<int>(i);
+    }
+}
+
+gltop::ProcessStore::ProcessStore()
+    : mAdoptOrphans(false),mTids(),mIndex(),mPPids(),mStartTimes(),mRss(),
+      mVsz(),mCpu(),mPss(),mUss(),mMemoryTimes(),mIoRead(),mIoWrite(),
+      mIoReadCalls(),mIoWriteCalls(),mNumThreads(),mHistorySlots(),mNameIds(),
+      mParents(),mChildStart(),mChildren(),mSiblings(),mRoots(),
+      mPreorder(),mPreorderPos(),mDepths(),mSubtreeSizes(),mSubtreeRss(),
+      mSubtreeCpu(),mCursor(),mThreadStart(),mThreads(),mNames(),
+      mNameIndex()
+{
+}
+
+gltop::ProcessStore::NameId gltop::ProcessStore::intern(const char *comm)
+{
+    std::string_view name(comm, strnlen(comm, sizeof(ProcInfo::cmd) - 1));
+    auto iter = mNameIndex.find(name);
+    if(iter != mNameIndex.end())
+        return iter->second;
+
+    auto id = static_cast<NameId>(mNames.size());
+    auto &stored = mNames.emplace_back();
+    std::memcpy(stored.data(), name.data(), name.size());
+    stored[name.size()] = '\0';
+    mNameIndex.emplace(std::string_view(stored.data(), name.size()), id);
+    return id;
+}
+
+void gltop::ProcessStore::assign(const std::map<int, Process> &processes)
+{
+    std::size_t n = processes.size();
+    mTids.resize(n);
+    mPPids.resize(n);
+    mStartTimes.resize(n);
+    mRss.resize(n);
+    mVsz.resize(n);
+    mCpu.resize(n);
+    mPss.resize(n);
+    mUss.resize(n);
+    mMemoryTimes.resize(n);
+    mIoRead.resize(n);
+    mIoWrite.resize(n);
+    mIoReadCalls.resize(n);
+    mIoWriteCalls.resize(n);
+    mNumThreads.resize(n);
+    mHistorySlots.resize(n);
+    mNameIds.resize(n);
+    mThreadStart.resize(n + 1);
+    mThreads.clear();
+
+    // Names of processes long gone pile up; start the table again once
+    // they outnumber the live ones.
+    if(mNames.size() > 2 * n + 64)
+    {
+        mNameIndex.clear();
+        mNames.clear();
+    }
+
+    std::size_t i = 0;
+    for(auto &[pid, proc] : processes)
+    {
+        mTids[i] = pid;
+        mPPids[i] = proc.getPPID();
+        mStartTimes[i] = proc.getStartTime();
+        mRss[i] = proc.getRSS();
+        mVsz[i] = proc.getVMem();
+        mCpu[i] = proc.getCPU();
+        mPss[i] = proc.getPSS();
+        mUss[i] = proc.getUSS();
+        mMemoryTimes[i] = proc.getMemoryTime();
+        const auto &io = proc.getIoRates();
+        mIoRead[i] = io.readBytes;
+        mIoWrite[i] = io.writeBytes;
+        mIoReadCalls[i] = io.syscr;
+        mIoWriteCalls[i] = io.syscw;
+        mNumThreads[i] = proc.getNumThreads();
+        mHistorySlots[i] = proc.getHistorySlot();
+        mNameIds[i] = intern(proc.getBasename().data());
+        mThreadStart[i] = static_cast<int>(mThreads.size());
+        const auto &threads = proc.getThreads();
+        mThreads.insert(mThreads.end(), threads.begin(), threads.end());
+        i++;
+    }
+    mThreadStart[n] = static_cast<int>(mThreads.size());
+
+    mIndex.build(mTids);
+    buildTree();
+    sumSubtrees();
+}
+
+void gltop::ProcessStore::buildTree()
+{
+    std::size_t n = mTids.size();
+    mParents.resize(n);
+    mChildStart.assign(n + 1, 0);
+    mRoots.clear();
+
+    for(std::size_t i = 0; i < n; i++)
+    {
+        int parent = (mPPids[i] != mTids[i]) ? find(mPPids[i]) : -1;
+        if(parent < 0 && mAdoptOrphans && mTids[i] != 1)
+            parent = find(1);
+        mParents[i] = parent;
+        if(parent >= 0)
+            mChildStart[parent + 1]++;
+        else
+            mRoots.push_back(static_cast<int>(i));
+    }
+
+    // Count, then place: each list comes out in pid order.
+    for(std::size_t i = 0; i < n; i++)
+        mChildStart[i + 1] += mChildStart[i];
+    mChildren.resize(static_cast<std::size_t>(mChildStart[n]));
+    mSiblings.assign(n, 0);
+    mCursor.assign(mChildStart.begin(), mChildStart.end() - 1);
+    for(std::size_t i = 0; i < n; i++)
+    {
+        int parent = mParents[i];
+        if(parent < 0)
+            continue;
+        mSiblings[i] = mCursor[parent] - mChildStart[parent];
+        mChildren[mCursor[parent]++] = static_cast<int>(i);
+    }
+}
+
+void gltop::ProcessStore::sumSubtrees()
+{
+    std::size_t n = mTids.size();
+    mDepths.assign(n, 0);
+    mSubtreeSizes.assign(n, 1);
+    mSubtreeRss.assign(mRss.begin(), mRss.end());
+    mSubtreeCpu.assign(mCpu.begin(), mCpu.end());
+
+    // Depth first from the roots, with an explicit stack so deep trees
+    // cannot overflow anything. Children go on in reverse so they come
+    // off in pid order.
+    mPreorder.clear();
+    mPreorderPos.assign(n, -1);
+    mCursor.assign(mRoots.rbegin(), mRoots.rend());
+    while(!mCursor.empty())
+    {
+        int node = mCursor.back();
+        mCursor.pop_back();
+        mPreorderPos[node] = static_cast<int>(mPreorder.size());
+        mPreorder.push_back(node);
+        for(int i = mChildStart[node + 1] - 1; i >= mChildStart[node]; i--)
+        {
+            int child = mChildren[i];
+            mDepths[child] = mDepths[node] + 1;
+            mCursor.push_back(child);
+        }
+    }
+
+    // Backwards, every node comes after all of its descendants, so each
+    // one's totals are complete by the time they are added to its parent.
+    for(auto iter = mPreorder.rbegin(); iter != mPreorder.rend(); ++iter)
+    {
+        int parent = mParents[*iter];
+        if(parent < 0)
+            continue;
+        mSubtreeSizes[parent] += mSubtreeSizes[*iter];
+        mSubtreeRss[parent] += mSubtreeRss[*iter];
+        mSubtreeCpu[parent] += mSubtreeCpu[*iter];
+    }
+
+    // Nodes on a ppid cycle are never reached. They go on the end on
+    // their own, keeping their own values.
+    for(std::size_t i = 0; i < n; i++)
+        if(mPreorderPos[i] < 0)
+        {
+            mPreorderPos[i] = static_cast<int>(mPreorder.size());
+            mPreorder.push_back(static_cast<int>(i));
+        }
+}
@@ -0,0 +1,576 @@
+#ifndef GLTOP_STORE_HPP
+#define GLTOP_STORE_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "gltop.hpp"
+
+namespace gltop
+{
+    // A run of contiguous elements.
+    template<typename T>
+    struct Range
+    {
+        const T *first = nullptr;
+        const T *last = nullptr;
+
+        inline const T *begin() const
+        {
+            return first;
+        }
+
+        inline const T *end() const
+        {
+            return last;
+        }
+
+        inline std::size_t size() const
+        {
+            return static_cast<std::size_t>(last - first);
+        }
+
+        inline bool empty() const
+        {
+            return first == last;
+        }
+
+        inline const T &operator[](std::size_t i) const
+        {
+            return first[i];
+        }
+    };
+
+    // Maps pids to slots in O(1). Normally a flat array with an entry for
+    // every possible pid (from /proc/sys/kernel/pid_max); if that would be
+    // too big, an open addressing hash table sized from the number of
+    // pids instead. Lookups never modify it.
+    class PidIndex
+    {
+    public:
+        // Largest pid range kept as a flat array (4 MiB of slots).
+        static constexpr std::size_t DIRECT_LIMIT = 1u << 20;
+
+        PidIndex();
+
+        ~PidIndex() = default;
+
+        // Index pids; the slot of pids[i] is i.
+        void build(const std::vector<int> &pids);
+
+        // Slot of pid, -1 if it is not indexed.
+        inline int find(int pid) const
+        {
+            if(pid < 0)
+                return -1;
+            if(!mDirect.empty())
+                return (static_cast<std::size_t>(pid) < mDirect.size())
+                    ? mDirect[pid] : -1;
+            if(mKeys.empty())
+                return -1;
+            for(std::size_t i = hash(pid);; i = (i + 1) & mMask)
+            {
+                if(mKeys[i] == pid)
+                    return mSlots[i];
+                if(mKeys[i] < 0)
+                    return -1;
+            }
+        }
+
+        // True if using the flat array.
+        inline bool isDirect() const
+        {
+            return !mDirect.empty();
+        }
+
+        // Use pidMax instead of the pid_max read at construction.
+        inline void setPidMax(std::size_t pidMax)
+        {
+            mPidMax = pidMax;
+        }
+
+        // pid_max of the procfs at procRoot, or a default if it could not
+        // be read.
+        static std::size_t readPidMax(const std::string &procRoot = "/proc");
+
+    private:
+        inline std::size_t hash(int pid) const
+        {
+            return (static_cast<std::uint32_t>(pid) * 0x9E3779B1u
+                    >> mShift) & mMask;
+        }
+
+        // Entries of the possible pids.
+        std::size_t mPidMax;
+        // Flat array, and the pids set in it (to clear them cheaply).
+        std::vector<int> mDirect;
+        std::vector<int> mSet;
+        // Hash table: pids (-1 for empty) and their slots.
+        std::vector<int> mKeys;
+        std::vector<int> mSlots;
+        std::size_t mMask;
+        unsigned mShift;
+    };
+
+    class ProcessStore;
+
+    // One process in a ProcessStore: just the store and a slot.
+    class ProcessView
+    {
+    public:
+        // A NULL process.
+        ProcessView() : mStore(nullptr),mSlot(-1)
+        {
+        }
+
+        ProcessView(const ProcessStore *store, int slot)
+            : mStore(store),mSlot(slot)
+        {
+        }
+
+        ~ProcessView() = default;
+
+        inline bool isNull() const
+        {
+            return mSlot < 0;
+        }
+
+        inline operator bool() const
+        {
+            return !isNull();
+        }
+
+        inline int getSlot() const
+        {
+            return mSlot;
+        }
+
+        // The accessors below must not be called on a NULL process.
+        inline int getTID() const;
+        inline int getPPID() const;
+        inline unsigned long long getStartTime() const;
+        // Virtual memory and resident set size (kB).
+        inline unsigned long getVMem() const;
+        inline unsigned long getRSS() const;
+        // CPU use over the last interval (%).
+        inline float getCPU() const;
+        // PSS and USS (kB), read at getMemoryTime() (the clock's epoch for
+        // never, when they are 0).
+        inline unsigned long getPSS() const;
+        inline unsigned long getUSS() const;
+        inline std::chrono::steady_clock::time_point getMemoryTime() const;
+        inline bool hasMemoryDetail() const;
+        // I/O per second: bytes to and from storage, and read and write
+        // calls. All 0 unless the collector samples I/O.
+        inline float getIoRead() const;
+        inline float getIoWrite() const;
+        inline float getIoReadCalls() const;
+        inline float getIoWriteCalls() const;
+        // Depth in the tree (0 for roots).
+        inline int getDepth() const;
+        // Totals over this process and all its descendants.
+        inline int getSubtreeSize() const;
+        inline unsigned long long getSubtreeRSS() const;
+        inline float getSubtreeCPU() const;
+        inline long getNumThreads() const;
+        // Slot in the History, or -1.
+        inline int getHistorySlot() const;
+        // NUL terminated; lives as long as the store's contents.
+        inline std::string_view getBasename() const;
+        // Slots of the children, in pid order.
+        inline Range<int> getChildren() const;
+        // Index among the parent's children (0 for roots).
+        inline int getSiblingIndex() const;
+        // Slots of this process and all its descendants, depth first.
+        inline Range<int> getSubtree() const;
+        // The parent, NULL for a root.
+        inline ProcessView getParent() const;
+        // Threads, if the table read them.
+        inline Range<ThreadInfo> getThreads() const;
+
+    private:
+        const ProcessStore *mStore;
+        int mSlot;
+    };
+
+    // The process table as columns, one entry per process in pid order,
+    // with the tree stored as parent slots and children lists packed end
+    // to end (compressed sparse rows). Depth and subtree totals come from
+    // a single pass over the tree when it is built. Walking it for layout
+    // and drawing reads a few dense arrays instead of chasing map nodes.
+    // Filling it again reuses the storage.
+    class ProcessStore
+    {
+    public:
+        // Id of a comm in the store's name table.
+        using NameId = std::uint32_t;
+
+        ProcessStore();
+
+        ~ProcessStore() = default;
+
+        // Replace the contents with processes.
+        void assign(const std::map<int, Process> &processes);
+
+        // pid_max of the procfs the processes come from, which decides how
+        // they are indexed.
+        inline void setPidMax(std::size_t pidMax)
+        {
+            mIndex.setPidMax(pidMax);
+        }
+
+        // Hang processes whose parent is missing off init, instead of
+        // making them roots. For filtered tables, which leave gaps; the
+        // ppids are kept as they are.
+        inline void setAdoptOrphans(bool adoptOrphans)
+        {
+            mAdoptOrphans = adoptOrphans;
+        }
+
+        inline std::size_t size() const
+        {
+            return mTids.size();
+        }
+
+        inline bool empty() const
+        {
+            return mTids.empty();
+        }
+
+        // Slot of pid, -1 if it is not in the store.
+        inline int find(int pid) const
+        {
+            return mIndex.find(pid);
+        }
+
+        inline ProcessView get(int slot) const
+        {
+            return ProcessView(this, slot);
+        }
+
+        // The process with pid (NULL if it is not there).
+        inline ProcessView getProcess(int pid) const
+        {
+            return ProcessView(this, find(pid));
+        }
+
+        // Slots of the processes with no parent in the store.
+        inline const std::vector<int> &getRoots() const
+        {
+            return mRoots;
+        }
+
+        // The columns.
+        inline const std::vector<int> &getTids() const
+        {
+            return mTids;
+        }
+
+        inline const std::vector<int> &getPPids() const
+        {
+            return mPPids;
+        }
+
+        inline const std::vector<unsigned long long> &getStartTimes() const
+        {
+            return mStartTimes;
+        }
+
+        inline const std::vector<unsigned long> &getRSS() const
+        {
+            return mRss;
+        }
+
+        inline const std::vector<unsigned long> &getVMem() const
+        {
+            return mVsz;
+        }
+
+        inline const std::vector<float> &getCPU() const
+        {
+            return mCpu;
+        }
+
+        inline const std::vector<unsigned long> &getPSS() const
+        {
+            return mPss;
+        }
+
+        inline const std::vector<unsigned long> &getUSS() const
+        {
+            return mUss;
+        }
+
+        inline const std::vector<std::chrono::steady_clock::time_point> &
+        getMemoryTimes() const
+        {
+            return mMemoryTimes;
+        }
+
+        inline const std::vector<float> &getIoRead() const
+        {
+            return mIoRead;
+        }
+
+        inline const std::vector<float> &getIoWrite() const
+        {
+            return mIoWrite;
+        }
+
+        inline const std::vector<float> &getIoReadCalls() const
+        {
+            return mIoReadCalls;
+        }
+
+        inline const std::vector<float> &getIoWriteCalls() const
+        {
+            return mIoWriteCalls;
+        }
+
+        inline const std::vector<int> &getDepths() const
+        {
+            return mDepths;
+        }
+
+        inline const std::vector<int> &getSubtreeSizes() const
+        {
+            return mSubtreeSizes;
+        }
+
+        inline const std::vector<unsigned long long> &getSubtreeRSS() const
+        {
+            return mSubtreeRss;
+        }
+
+        inline const std::vector<float> &getSubtreeCPU() const
+        {
+            return mSubtreeCpu;
+        }
+
+        // Every slot in depth first order: roots in pid order, each
+        // followed by its subtree, children in pid order.
+        inline const std::vector<int> &getPreorder() const
+        {
+            return mPreorder;
+        }
+
+        inline const std::vector<NameId> &getNameIds() const
+        {
+            return mNameIds;
+        }
+
+        inline const std::vector<int> &getParents() const
+        {
+            return mParents;
+        }
+
+        // The comm with the given id, NUL terminated.
+        inline std::string_view getName(NameId id) const
+        {
+            return mNames[id].data();
+        }
+
+    private:
+        friend class ProcessView;
+
+        // Id of comm, adding it to the name table if it is new.
+        NameId intern(const char *comm);
+
+        // Work out parents, children and roots from the ppids.
+        void buildTree();
+
+        // Fill in the depths and subtree totals.
+        void sumSubtrees();
+
+        bool mAdoptOrphans;
+        std::vector<int> mTids;
+        // Pid to slot.
+        PidIndex mIndex;
+        std::vector<int> mPPids;
+        std::vector<unsigned long long> mStartTimes;
+        std::vector<unsigned long> mRss;
+        std::vector<unsigned long> mVsz;
+        std::vector<float> mCpu;
+        std::vector<unsigned long> mPss;
+        std::vector<unsigned long> mUss;
+        std::vector<std::chrono::steady_clock::time_point> mMemoryTimes;
+        std::vector<float> mIoRead;
+        std::vector<float> mIoWrite;
+        std::vector<float> mIoReadCalls;
+        std::vector<float> mIoWriteCalls;
+        std::vector<long> mNumThreads;
+        std::vector<int> mHistorySlots;
+        std::vector<NameId> mNameIds;
+        // Tree: parent slot (-1 for roots), and each slot's children at
+        // mChildren[mChildStart[slot]] up to mChildStart[slot + 1].
+        std::vector<int> mParents;
+        std::vector<int> mChildStart;
+        std::vector<int> mChildren;
+        std::vector<int> mSiblings;
+        std::vector<int> mRoots;
+        // Filled in by sumSubtrees(). mPreorderPos is the inverse of
+        // mPreorder.
+        std::vector<int> mPreorder;
+        std::vector<int> mPreorderPos;
+        std::vector<int> mDepths;
+        std::vector<int> mSubtreeSizes;
+        std::vector<unsigned long long> mSubtreeRss;
+        std::vector<float> mSubtreeCpu;
+        // Scratch for buildTree() and sumSubtrees().
+        std::vector<int> mCursor;
+        // Threads, packed the same way.
+        std::vector<int> mThreadStart;
+        std::vector<ThreadInfo> mThreads;
+        // Distinct comms (a deque so the views in mNameIndex stay valid).
+        std::deque<std::array<char, 16>> mNames;
+        std::unordered_map<std::string_view, NameId> mNameIndex;
+    };
+
+    inline int ProcessView::getTID() const
+    {
+        return mStore->mTids[mSlot];
+    }
+
+    inline int ProcessView::getPPID() const
+    {
+        return mStore->mPPids[mSlot];
+    }
+
+    inline unsigned long long ProcessView::getStartTime() const
+    {
+        return mStore->mStartTimes[mSlot];
+    }
+
+    inline unsigned long ProcessView::getVMem() const
+    {
+        return mStore->mVsz[mSlot];
+    }
+
+    inline unsigned long ProcessView::getRSS() const
+    {
+        return mStore->mRss[mSlot];
+    }
+
+    inline float ProcessView::getCPU() const
+    {
+        return mStore->mCpu[mSlot];
+    }
+
+    inline int ProcessView::getDepth() const
+    {
+        return mStore->mDepths[mSlot];
+    }
+
+    inline int ProcessView::getSubtreeSize() const
+    {
+        return mStore->mSubtreeSizes[mSlot];
+    }
+
+    inline unsigned long long ProcessView::getSubtreeRSS() const
+    {
+        return mStore->mSubtreeRss[mSlot];
+    }
+
+    inline float ProcessView::getSubtreeCPU() const
+    {
+        return mStore->mSubtreeCpu[mSlot];
+    }
+
+    inline long ProcessView::getNumThreads() const
+    {
+        return mStore->mNumThreads[mSlot];
+    }
+
+    inline unsigned long ProcessView::getPSS() const
+    {
+        return mStore->mPss[mSlot];
+    }
+
+    inline unsigned long ProcessView::getUSS() const
+    {
+        return mStore->mUss[mSlot];
+    }
+
+    inline std::chrono::steady_clock::time_point
+    ProcessView::getMemoryTime() const
+    {
+        return mStore->mMemoryTimes[mSlot];
+    }
+
+    inline bool ProcessView::hasMemoryDetail() const
+    {
+        return getMemoryTime() != std::chrono::steady_clock::time_point();
+    }
+
+    inline float ProcessView::getIoRead() const
+    {
+        return mStore->mIoRead[mSlot];
+    }
+
+    inline float ProcessView::getIoWrite() const
+    {
+        return mStore->mIoWrite[mSlot];
+    }
+
+    inline float ProcessView::getIoReadCalls() const
+    {
+        return mStore->mIoReadCalls[mSlot];
+    }
+
+    inline float ProcessView::getIoWriteCalls() const
+    {
+        return mStore->mIoWriteCalls[mSlot];
+    }
+
+    inline int ProcessView::getHistorySlot() const
+    {
+        return mStore->mHistorySlots[mSlot];
+    }
+
+    inline std::string_view ProcessView::getBasename() const
+    {
+        return mStore->getName(mStore->mNameIds[mSlot]);
+    }
+
+    inline Range<int> ProcessView::getChildren() const
+    {
+        const int *children = mStore->mChildren.data();
+        return { children + mStore->mChildStart[mSlot],
+                 children + mStore->mChildStart[mSlot + 1] };
+    }
+
+    inline int ProcessView::getSiblingIndex() const
+    {
+        return mStore->mSiblings[mSlot];
+    }
+
+    inline Range<int> ProcessView::getSubtree() const
+    {
+        // A subtree is contiguous in the preorder.
+        const int *first = mStore->mPreorder.data()
+            + mStore->mPreorderPos[mSlot];
+        return { first, first + mStore->mSubtreeSizes[mSlot] };
+    }
+
+    inline ProcessView ProcessView::getParent() const
+    {
+        return ProcessView(mStore, mStore->mParents[mSlot]);
+    }
+
+    inline Range<ThreadInfo> ProcessView::getThreads() const
+    {
+        const ThreadInfo *threads = mStore->mThreads.data();
+        return { threads + mStore->mThreadStart[mSlot],
+                 threads + mStore->mThreadStart[mSlot + 1] };
+    }
+}
+
+#endif /* GLTOP_STORE_HPP */
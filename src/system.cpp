@@ -0,0 +1,292 @@
+extern "C" {
+#include <unistd.h>
+#include <fcntl.h>
+}
+
+#include <algorithm>
+#include <cstring>
+
+#include "system.hpp"
+
+namespace
+{
+    // Paths of SystemSampler::File, relative to the procfs root.
+    constexpr const char *FILE_NAMES[] = {
+        "meminfo",
+        "stat",
+        "loadavg",
+        "pressure/cpu",
+        "pressure/memory",
+        "pressure/io",
+    };
+
+    // The meminfo keys we want, in the order the kernel prints them.
+    struct MeminfoKey
+    {
+        const char *name;
+        std::size_t length;
+        unsigned long gltop::SystemStats::*field;
+    };
+
+    constexpr MeminfoKey MEMINFO_KEYS[] = {
+        { "MemTotal", 8, &gltop::SystemStats::memTotal },
+        { "MemFree", 7, &gltop::SystemStats::memFree },
+        { "MemAvailable", 12, &gltop::SystemStats::memAvailable },
+        { "Buffers", 7, &gltop::SystemStats::buffers },
+        { "Cached", 6, &gltop::SystemStats::cached },
+        { "SwapTotal", 9, &gltop::SystemStats::swapTotal },
+        { "SwapFree", 8, &gltop::SystemStats::swapFree },
+    };
+    constexpr std::size_t MEMINFO_KEY_COUNT = std::size(MEMINFO_KEYS);
+
+    inline const char *skipSpace(const char *p, const char *end)
+    {
+        while(p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        return p;
+    }
+
+    inline unsigned long long parseULL(const char *&p, const char *end)
+    {
+        p = skipSpace(p, end);
+        unsigned long long result = 0;
+        for(; p < end && *p >= '0' && *p <= '9'; p++)
+            result = result * 10 + static_cast<unsigned long long>(*p - '0');
+        return result;
+    }
+
+    // Parse a non-negative decimal with a fraction ("12.34").
+    inline float parseFloat(const char *&p, const char *end)
+    {
+        auto whole = static_cast<float>(parseULL(p, end));
+        if(p < end && *p == '.')
+        {
+            float scale = 0.1f;
+            for(p++; p < end && *p >= '0' && *p <= '9'; p++, scale *= 0.1f)
+                whole += static_cast<float>(*p - '0') * scale;
+        }
+        return whole;
+    }
+
+    inline const char *nextLine(const char *p, const char *end)
+    {
+        auto eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        return eol ? eol + 1 : end;
+    }
+
+    inline bool startsWith(const char *p, const char *end, const char *key,
+                           std::size_t length)
+    {
+        return static_cast<std::size_t>(end - p) >= length
+            && std::memcmp(p, key, length) == 0;
+    }
+
+    // Busy share (%) of the time between last and now.
+    inline float getBusyPercent(const gltop::CpuTimes &last,
+                                const gltop::CpuTimes &now)
+    {
+        auto total = now.getTotal() - last.getTotal();
+        if(now.getTotal() < last.getTotal() || total == 0)
+            return 0.f;
+        auto busy = (now.getBusy() >= last.getBusy())
+            ? now.getBusy() - last.getBusy() : 0;
+        return 100.f * static_cast<float>(busy) / static_cast<float>(total);
+    }
+}
+
+gltop::SystemSampler::SystemSampler(const std::string &root)
+    : mFds(),mMeminfoHint(0),mBuf(16384),mLastCpu(),mLastCpus()
+{
+    for(int &fd : mFds)
+        fd = -1;
+    open(root);
+}
+
+gltop::SystemSampler::~SystemSampler()
+{
+    for(int fd : mFds)
+        if(fd >= 0)
+            close(fd);
+}
+
+void gltop::SystemSampler::open(const std::string &root)
+{
+    int rootFd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    for(int i = 0; i < FILE_COUNT; i++)
+    {
+        if(mFds[i] >= 0)
+            close(mFds[i]);
+        mFds[i] = (rootFd >= 0)
+            ? openat(rootFd, FILE_NAMES[i], O_RDONLY | O_CLOEXEC) : -1;
+    }
+    if(rootFd >= 0)
+        close(rootFd);
+    mLastCpu = CpuTimes();
+    mLastCpus.clear();
+}
+
+long gltop::SystemSampler::readFile(File file)
+{
+    int fd = mFds[file];
+    if(fd < 0)
+        return -1;
+    for(;;)
+    {
+        ssize_t len = pread(fd, mBuf.data(), mBuf.size(), 0);
+        if(len < 0)
+            return -1;
+        if(static_cast<std::size_t>(len) < mBuf.size())
+            return len;
+        // Filled the buffer; the file may be longer.
+        mBuf.resize(mBuf.size() * 2);
+    }
+}
+
+void gltop::SystemSampler::sample(SystemStats &stats)
+{
+    long len;
+    if((len = readFile(MEMINFO)) > 0)
+        parseMeminfo(static_cast<std::size_t>(len), stats);
+    if((len = readFile(STAT)) > 0)
+        parseStat(static_cast<std::size_t>(len), stats);
+    if((len = readFile(LOADAVG)) > 0)
+        parseLoadavg(static_cast<std::size_t>(len), stats);
+
+    stats.hasPressure = mFds[PRESSURE_CPU] >= 0;
+    if((len = readFile(PRESSURE_CPU)) > 0)
+        parsePressure(static_cast<std::size_t>(len), stats.cpuPressure);
+    if((len = readFile(PRESSURE_MEMORY)) > 0)
+        parsePressure(static_cast<std::size_t>(len), stats.memoryPressure);
+    if((len = readFile(PRESSURE_IO)) > 0)
+        parsePressure(static_cast<std::size_t>(len), stats.ioPressure);
+}
+
+void gltop::SystemSampler::parseMeminfo(std::size_t len, SystemStats &stats)
+{
+    const char *end = mBuf.data() + len;
+    std::size_t found = 0;
+    for(const char *line = mBuf.data();
+        line < end && found < MEMINFO_KEY_COUNT; line = nextLine(line, end))
+    {
+        auto colon = static_cast<const char *>(std::memchr(line, ':',
+                                                           end - line));
+        if(!colon)
+            break;
+        auto length = static_cast<std::size_t>(colon - line);
+
+        // The keys come in a fixed order, so the one after the last match
+        // is nearly always the next to match.
+        for(std::size_t i = 0; i < MEMINFO_KEY_COUNT; i++)
+        {
+            std::size_t k = (mMeminfoHint + i) % MEMINFO_KEY_COUNT;
+            const auto &key = MEMINFO_KEYS[k];
+            if(key.length == length
+               && std::memcmp(line, key.name, length) == 0)
+            {
+                const char *p = colon + 1;
+                stats.*key.field = static_cast<unsigned long>
+                    (parseULL(p, end));
+                mMeminfoHint = (k + 1) % MEMINFO_KEY_COUNT;
+                found++;
+                break;
+            }
+        }
+    }
+}
+
+void gltop::SystemSampler::parseStat(std::size_t len, SystemStats &stats)
+{
+    const char *end = mBuf.data() + len;
+    std::size_t cpus = 0;
+    for(const char *line = mBuf.data(); line < end;
+        line = nextLine(line, end))
+    {
+        if(startsWith(line, end, "cpu", 3))
+        {
+            const char *p = line + 3;
+            CpuTimes *times = &stats.cpu;
+            if(p < end && *p != ' ')
+            {
+                // cpuN
+                parseULL(p, end);
+                if(stats.cpus.size() <= cpus)
+                    stats.cpus.resize(cpus + 1);
+                times = &stats.cpus[cpus++];
+            }
+            times->user = parseULL(p, end);
+            times->nice = parseULL(p, end);
+            times->system = parseULL(p, end);
+            times->idle = parseULL(p, end);
+            times->iowait = parseULL(p, end);
+            times->irq = parseULL(p, end);
+            times->softirq = parseULL(p, end);
+            times->steal = parseULL(p, end);
+        }
+        else if(startsWith(line, end, "ctxt ", 5))
+        {
+            const char *p = line + 5;
+            stats.contextSwitches = parseULL(p, end);
+        }
+        else if(startsWith(line, end, "processes ", 10))
+        {
+            const char *p = line + 10;
+            stats.forks = parseULL(p, end);
+        }
+        else if(startsWith(line, end, "procs_running ", 14))
+        {
+            const char *p = line + 14;
+            stats.procsRunning = static_cast<unsigned>(parseULL(p, end));
+        }
+        else if(startsWith(line, end, "procs_blocked ", 14))
+        {
+            const char *p = line + 14;
+            stats.procsBlocked = static_cast<unsigned>(parseULL(p, end));
+            // Nothing we want comes after this.
+            break;
+        }
+    }
+    stats.cpus.resize(cpus);
+
+    stats.cpuBusy = getBusyPercent(mLastCpu, stats.cpu);
+    mLastCpu = stats.cpu;
+    stats.cpusBusy.resize(cpus);
+    mLastCpus.resize(cpus);
+    for(std::size_t i = 0; i < cpus; i++)
+    {
+        stats.cpusBusy[i] = getBusyPercent(mLastCpus[i], stats.cpus[i]);
+        mLastCpus[i] = stats.cpus[i];
+    }
+}
+
+void gltop::SystemSampler::parseLoadavg(std::size_t len, SystemStats &stats)
+{
+    const char *p = mBuf.data();
+    const char *end = p + len;
+    for(float &load : stats.load)
+        load = parseFloat(p, end);
+}
+
+void gltop::SystemSampler::parsePressure(std::size_t len, Pressure &pressure)
+{
+    // "some avg10=0.00 avg60=0.00 avg300=0.00 total=0", then "full ...".
+    const char *end = mBuf.data() + len;
+    for(const char *line = mBuf.data(); line < end;
+        line = nextLine(line, end))
+    {
+        float *averages = startsWith(line, end, "some", 4) ? pressure.some
+            : startsWith(line, end, "full", 4) ? pressure.full : nullptr;
+        if(!averages)
+            continue;
+        const char *p = line + 4;
+        const char *eol = nextLine(line, end);
+        for(int i = 0; i < 3; i++)
+        {
+            auto equals = static_cast<const char *>(std::memchr(p, '=',
+                                                                eol - p));
+            if(!equals)
+                break;
+            p = equals + 1;
+            averages[i] = parseFloat(p, eol);
+        }
+    }
+}
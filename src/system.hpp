@@ -0,0 +1,124 @@
+#ifndef GLTOP_SYSTEM_HPP
+#define GLTOP_SYSTEM_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gltop
+{
+    // Time spent by a CPU in each state (clock ticks), from /proc/stat.
+    struct CpuTimes
+    {
+        unsigned long long user = 0;
+        unsigned long long nice = 0;
+        unsigned long long system = 0;
+        unsigned long long idle = 0;
+        unsigned long long iowait = 0;
+        unsigned long long irq = 0;
+        unsigned long long softirq = 0;
+        unsigned long long steal = 0;
+
+        inline unsigned long long getTotal() const
+        {
+            return user + nice + system + idle + iowait + irq + softirq
+                + steal;
+        }
+
+        inline unsigned long long getBusy() const
+        {
+            return getTotal() - idle - iowait;
+        }
+    };
+
+    // One line of a /proc/pressure file: the share of time (%) some or all
+    // tasks were stalled, averaged over 10, 60 and 300 seconds.
+    struct Pressure
+    {
+        float some[3] = {};
+        float full[3] = {};
+    };
+
+    // System wide figures, as of one SystemSampler::sample().
+    struct SystemStats
+    {
+        // /proc/meminfo (kB).
+        unsigned long memTotal = 0;
+        unsigned long memFree = 0;
+        unsigned long memAvailable = 0;
+        unsigned long buffers = 0;
+        unsigned long cached = 0;
+        unsigned long swapTotal = 0;
+        unsigned long swapFree = 0;
+        // /proc/stat: all CPUs together and each on its own, and how busy
+        // they were (%) since the previous sample.
+        CpuTimes cpu;
+        std::vector<CpuTimes> cpus;
+        float cpuBusy = 0.f;
+        std::vector<float> cpusBusy;
+        unsigned long long contextSwitches = 0;
+        unsigned long long forks = 0;
+        unsigned procsRunning = 0;
+        unsigned procsBlocked = 0;
+        // /proc/loadavg.
+        float load[3] = {};
+        // /proc/pressure, if the kernel has it.
+        bool hasPressure = false;
+        Pressure cpuPressure;
+        Pressure memoryPressure;
+        Pressure ioPressure;
+    };
+
+    // Samples the system wide files under /proc. They are opened once and
+    // re-read with pread() into fixed buffers each time, and parsed
+    // without allocating (once the CPU count is known).
+    class SystemSampler
+    {
+    public:
+        SystemSampler(const std::string &root = "/proc");
+
+        ~SystemSampler();
+
+        SystemSampler(const SystemSampler &) = delete;
+        SystemSampler &operator=(const SystemSampler &) = delete;
+
+        // Sample the procfs at root from now on.
+        void open(const std::string &root);
+
+        // Re-read everything into stats. Busy percentages are relative to
+        // the previous call (with the same stats).
+        void sample(SystemStats &stats);
+
+    private:
+        // Files kept open.
+        enum File
+        {
+            MEMINFO,
+            STAT,
+            LOADAVG,
+            PRESSURE_CPU,
+            PRESSURE_MEMORY,
+            PRESSURE_IO,
+            FILE_COUNT,
+        };
+
+        // pread() file into mBuf, returning the length (-1 on error).
+        long readFile(File file);
+
+        void parseMeminfo(std::size_t len, SystemStats &stats);
+        void parseStat(std::size_t len, SystemStats &stats);
+        void parseLoadavg(std::size_t len, SystemStats &stats);
+        void parsePressure(std::size_t len, Pressure &pressure);
+
+        int mFds[FILE_COUNT];
+        // Index into the meminfo key table to try first.
+        std::size_t mMeminfoHint;
+        // Big enough for /proc/stat on a few hundred CPUs; it grows if not.
+        std::vector<char> mBuf;
+        // CPU times at the previous sample.
+        CpuTimes mLastCpu;
+        std::vector<CpuTimes> mLastCpus;
+    };
+}
+
+#endif /* GLTOP_SYSTEM_HPP */
@@ -1,7 +1,14 @@
+extern "C" {
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+}
+
 #include "util.hpp"
 
 #include <string>
 #include <cstdint>
+#include <cstdlib>
 using namespace std::chrono_literals;
 using namespace std::string_literals;
 namespace chron = std::chrono;
@@ -55,6 +62,146 @@ gltop::Timer::durationRep gltop::Timer::internalElapseAll(float input)
     return result.count();
 }
 
+float gltop::RollingStats::getPercentile(float p)
+{
+    if(!mCount)
+        return 0.f;
+    std::copy(mSamples.begin(), mSamples.begin() + mCount, mScratch.begin());
+    auto rank = static_cast<std::size_t>(p / 100.f
+                                         * static_cast<float>(mCount - 1)
+                                         + 0.5f);
+    rank = std::min(rank, mCount - 1);
+    std::nth_element(mScratch.begin(), mScratch.begin() + rank,
+                     mScratch.begin() + mCount);
+    return mScratch[rank];
+}
+
+gltop::WorkerPool::WorkerPool(unsigned size)
+    : mThreads(),mMutex(),mStart(),mDone(),mJob(nullptr),mCount(0),
+      mGeneration(0),mPending(0),mStopping(false)
+{
+    for(unsigned i = 1; i < size; i++)
+        mThreads.emplace_back(&WorkerPool::work, this, i);
+}
+
+gltop::WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mStart.notify_all();
+    for(auto &thread : mThreads)
+        thread.join();
+}
+
+void gltop::WorkerPool::run(std::size_t n, const job &fn)
+{
+    if(mThreads.empty())
+    {
+        fn(0, 0, n);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJob = &fn;
+        mCount = n;
+        mPending = static_cast<unsigned>(mThreads.size());
+        mGeneration++;
+    }
+    mStart.notify_all();
+
+    fn(0, 0, getShardBegin(1));
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDone.wait(lock, [this]() { return mPending == 0; });
+    mJob = nullptr;
+}
+
+void gltop::WorkerPool::work(unsigned worker)
+{
+    std::uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mMutex);
+    for(;;)
+    {
+        mStart.wait(lock, [&]() { return mStopping || mGeneration != seen; });
+        if(mStopping)
+            return;
+        seen = mGeneration;
+        const job *fn = mJob;
+        std::size_t begin = getShardBegin(worker);
+        std::size_t end = (worker + 1 < getSize())
+            ? getShardBegin(worker + 1) : mCount;
+
+        lock.unlock();
+        (*fn)(worker, begin, end);
+        lock.lock();
+
+        if(--mPending == 0)
+            mDone.notify_one();
+    }
+}
+
+gltop::StringPool &gltop::StringPool::get()
+{
+    static StringPool *pool = new StringPool();
+    return *pool;
+}
+
+gltop::StringPool::StringPool()
+    : mMutex(),mStrings(),mBytes(0)
+{
+}
+
+gltop::StringPool::Handle gltop::StringPool::intern(std::string_view str)
+{
+    if(str.empty())
+        return Handle();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto iter = mStrings.find(str);
+    if(iter != mStrings.end())
+    {
+        if(auto handle = iter->second.weak.lock())
+            return handle;
+        // On its way out; its release() will see it is not ours any more.
+        mBytes -= iter->first.size();
+        mStrings.erase(iter);
+    }
+
+    auto copy = new std::string(str);
+    Handle handle(copy, [this](const std::string *dead) { release(dead); });
+    mStrings.emplace(*copy, Entry{ handle, copy });
+    mBytes += copy->size();
+    return handle;
+}
+
+void gltop::StringPool::release(const std::string *str)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto iter = mStrings.find(*str);
+        if(iter != mStrings.end() && iter->second.str == str)
+        {
+            mBytes -= str->size();
+            mStrings.erase(iter);
+        }
+    }
+    delete str;
+}
+
+std::size_t gltop::StringPool::size() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStrings.size();
+}
+
+std::size_t gltop::StringPool::getBytes() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mBytes;
+}
 
 std::vector<float> gltop::loadObjFile(const fs::path &path)
 {
@@ -72,3 +219,35 @@ std::vector<float> gltop::loadObjFile(const fs::path &path)
         float z;
     };
 }
+
+std::chrono::nanoseconds gltop::getThreadTime()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return chron::seconds(ts.tv_sec) + chron::nanoseconds(ts.tv_nsec);
+}
+
+std::chrono::nanoseconds gltop::getProcessTime()
+{
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return chron::seconds(ts.tv_sec) + chron::nanoseconds(ts.tv_nsec);
+}
+
+unsigned long gltop::getSelfRSS()
+{
+    char buf[128];
+    int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return 0;
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if(len <= 0)
+        return 0;
+    buf[len] = '\0';
+    // Size, then resident, in pages.
+    char *p = nullptr;
+    std::strtoul(buf, &p, 10);
+    unsigned long pages = std::strtoul(p, nullptr, 10);
+    return pages * static_cast<unsigned long>(sysconf(_SC_PAGESIZE) / 1024);
+}
@@ -1,10 +1,22 @@
 #ifndef GLTOP_UTIL_HPP
 #define GLTOP_UTIL_HPP
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 // TODO FIX ELAPSEANIMATE() TO BE RELATIVE TO MLASTTIME
 namespace gltop
@@ -138,7 +150,231 @@ namespace gltop
         callback mCallback;
     };
 
+    // Lock-free single producer, single consumer triple buffer. The writer
+    // fills getBack() and publish()es it; the reader calls update() and then
+    // reads getFront(), which the writer never touches. Neither side waits.
+    template<typename T>
+    class TripleBuffer
+    {
+    public:
+        TripleBuffer() : mBuffers(),mMiddle(1),mBack(0),mFront(2)
+        {
+        }
+
+        ~TripleBuffer() = default;
+
+        // Buffer for the writer to fill.
+        inline T &getBack()
+        {
+            return mBuffers[mBack];
+        }
+
+        // Hand the back buffer to the reader.
+        inline void publish()
+        {
+            mBack = mMiddle.exchange(mBack | DIRTY, std::memory_order_acq_rel)
+                & INDEX;
+        }
+
+        // Pick up the latest published buffer, if there is a new one.
+        inline bool update()
+        {
+            if(!(mMiddle.load(std::memory_order_relaxed) & DIRTY))
+                return false;
+            mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel)
+                & INDEX;
+            return true;
+        }
+
+        // Buffer for the reader.
+        inline const T &getFront() const
+        {
+            return mBuffers[mFront];
+        }
+
+    private:
+        static constexpr unsigned INDEX = 3;
+        static constexpr unsigned DIRTY = 4;
+
+        std::array<T, 3> mBuffers;
+        // Index of the middle buffer, plus DIRTY if the reader has not seen
+        // it yet.
+        std::atomic<unsigned> mMiddle;
+        unsigned mBack;
+        unsigned mFront;
+    };
+
+    // The last N samples of some timing, for percentiles.
+    class RollingStats
+    {
+    public:
+        RollingStats(std::size_t capacity = 1024)
+            : mSamples(capacity),mScratch(capacity),mNext(0),mCount(0)
+        {
+        }
+
+        ~RollingStats() = default;
+
+        inline void add(float sample)
+        {
+            mSamples[mNext] = sample;
+            mNext = (mNext + 1) % mSamples.size();
+            mCount = std::min(mCount + 1, mSamples.size());
+        }
+
+        inline std::size_t getCount() const
+        {
+            return mCount;
+        }
+
+        inline void clear()
+        {
+            mNext = 0;
+            mCount = 0;
+        }
+
+        // The p'th percentile (0 <= p <= 100) of the samples, 0 if none.
+        float getPercentile(float p);
+
+    private:
+        std::vector<float> mSamples;
+        std::vector<float> mScratch;
+        std::size_t mNext;
+        std::size_t mCount;
+    };
+
+    // Adds the time (ms) between its construction and destruction to a
+    // RollingStats. Given none it does nothing, not even read the clock.
+    class ScopedTimer
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        explicit ScopedTimer(RollingStats *stats)
+            : mStats(stats),mStart(stats ? clock::now() : clock::time_point())
+        {
+        }
+
+        ~ScopedTimer()
+        {
+            if(mStats)
+                mStats->add(std::chrono::duration<float, std::milli>
+                            (clock::now() - mStart).count());
+        }
+
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    private:
+        RollingStats *mStats;
+        clock::time_point mStart;
+    };
+
+    // Fixed set of threads that split a range of work between them.
+    class WorkerPool
+    {
+    public:
+        // Called with (worker, begin, end) for each shard.
+        using job = std::function<void(unsigned, std::size_t, std::size_t)>;
+
+        // Pool of size workers; the calling thread counts as worker 0, so
+        // a pool of 1 starts no threads.
+        WorkerPool(unsigned size = 1);
+
+        // Joins the threads.
+        ~WorkerPool();
+
+        WorkerPool(const WorkerPool &) = delete;
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        inline unsigned getSize() const
+        {
+            return static_cast<unsigned>(mThreads.size()) + 1;
+        }
+
+        // Split [0, n) into getSize() contiguous shards, in order, and run
+        // fn on each. Shard i goes to worker i. Returns once all are done.
+        void run(std::size_t n, const job &fn);
+
+    private:
+        // Thread body for worker.
+        void work(unsigned worker);
+
+        // Shard bounds for worker.
+        inline std::size_t getShardBegin(unsigned worker) const
+        {
+            return mCount * worker / getSize();
+        }
+
+        std::vector<std::thread> mThreads;
+        std::mutex mMutex;
+        std::condition_variable mStart;
+        std::condition_variable mDone;
+        // Current job and its size.
+        const job *mJob;
+        std::size_t mCount;
+        // Bumped for every job, so workers can tell a new one arrived.
+        std::uint64_t mGeneration;
+        // Workers still running the current job.
+        unsigned mPending;
+        bool mStopping;
+    };
+
+    // Stores each distinct string once. The strings are immutable, shared
+    // by everyone who interned them and freed along with the last handle,
+    // so copying a handle costs a reference count. Safe to use from
+    // several threads.
+    class StringPool
+    {
+    public:
+        // Null for the empty string.
+        using Handle = std::shared_ptr<const std::string>;
+
+        // The pool shared by the whole program. Never destroyed, so handles
+        // in static objects can outlive main().
+        static StringPool &get();
+
+        StringPool();
+
+        ~StringPool() = default;
+
+        StringPool(const StringPool &) = delete;
+        StringPool &operator=(const StringPool &) = delete;
+
+        // The pooled copy of str. Only allocates if it is not pooled yet.
+        Handle intern(std::string_view str);
+
+        // Number of distinct strings held, and their total length.
+        std::size_t size() const;
+        std::size_t getBytes() const;
+
+    private:
+        // Deleter for the pooled strings.
+        void release(const std::string *str);
+
+        struct Entry
+        {
+            std::weak_ptr<const std::string> weak;
+            const std::string *str;
+        };
+
+        mutable std::mutex mMutex;
+        // Keyed by views of the pooled strings themselves.
+        std::unordered_map<std::string_view, Entry> mStrings;
+        std::size_t mBytes;
+    };
+
     std::vector<float> loadObjFile(const std::filesystem::path &path);
+
+    // CPU time used so far by the calling thread.
+    std::chrono::nanoseconds getThreadTime();
+
+    // CPU time used so far by the whole of gltop.
+    std::chrono::nanoseconds getProcessTime();
+
+    // gltop's own resident set (kB), from the real /proc whatever root
+    // the collector reads; 0 if it cannot be read.
+    unsigned long getSelfRSS();
 }
 
 #endif /* GLTOP_UTIL_HPP */